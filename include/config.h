@@ -92,11 +92,13 @@ constexpr auto DEPTH_ADJUST = 0;
 #define TRANSPOSITION_TABLE_ENABLE
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
-#define CLEAR_TRANSPOSITION_TABLE
+/// Clear the transposition table before every iteration of the search
+/// instead of keeping it across iterations and moves.
+// #define CLEAR_TRANSPOSITION_TABLE
 #define TRANSPOSITION_TABLE_FAKE_CLEAN
 // #define TRANSPOSITION_TABLE_FAKE_CLEAN_NOT_EXACT_ONLY
-// #define TRANSPOSITION_TABLE_64BIT_KEY
-// #define TT_MOVE_ENABLE
+#define TRANSPOSITION_TABLE_64BIT_KEY
+#define TT_MOVE_ENABLE
 // #define TRANSPOSITION_TABLE_DEBUG
 #endif
 
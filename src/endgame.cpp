@@ -20,8 +20,81 @@
 using std::string;
 
 #ifdef ENDGAME_LEARNING
-static constexpr int endgameHashSize = 0x1000000; // 16M
 HashMap<Key, Endgame> endgameHashMap(endgameHashSize);
+EndgameTable endgameTable;
+
+namespace {
+
+// The filter in use and the one it replaced, which a search may still be
+// probing. The replaced one is freed by the next rebuild.
+std::unique_ptr<EndgameFilter> liveFilter = std::make_unique<EndgameFilter>(0);
+std::unique_ptr<EndgameFilter> retiredFilter;
+
+} // namespace
+
+std::atomic<EndgameFilter *> endgameFilter {liveFilter.get()};
+
+/// EndgameTable::load() maps a table file, which stays mapped until it is
+/// unloaded. A file of another format or key size, or of an inconsistent
+/// size, is rejected and leaves the table empty.
+
+bool EndgameTable::load(const std::string &fname)
+{
+    unload();
+
+    size_t size = 0;
+    const void *data = map_file(fname, size);
+
+    if (!data) {
+        return false;
+    }
+
+    const auto *p = static_cast<const char *>(data);
+    Header header {};
+
+    if (size >= sizeof(header)) {
+        std::memcpy(&header, p, sizeof(header));
+    }
+
+    if (size < sizeof(header) ||
+        std::memcmp(header.magic, Magic, sizeof(Magic)) ||
+        header.version != Version || header.keySize != sizeof(Key) ||
+        size != file_size(header.count)) {
+        debugPrintf("[endgame] Table %s rejected\n", fname.c_str());
+        unmap_file(data, size);
+        return false;
+    }
+
+    index = reinterpret_cast<const uint32_t *>(p + sizeof(header));
+    keys = reinterpret_cast<const Key *>(p + KeysOffset);
+    results = reinterpret_cast<const uint8_t *>(keys + header.count);
+
+    if (index[IndexSize] != header.count) {
+        debugPrintf("[endgame] Table %s rejected\n", fname.c_str());
+        unmap_file(data, size);
+        return false;
+    }
+
+    mem = data;
+    memSize = size;
+    count = static_cast<size_t>(header.count);
+
+    debugPrintf("[endgame] Table %s loaded (%zu entries)\n", fname.c_str(),
+                count);
+
+    return true;
+}
+
+void EndgameTable::unload()
+{
+    unmap_file(mem, memSize);
+    mem = nullptr;
+    memSize = 0;
+    count = 0;
+}
+
+// mergeEndgameFile() merges two endgame files in memory. The shards of many
+// workers are better merged by the endgame-merge tool, see endgame_merge.cpp.
 
 void mergeEndgameFile(const string &file1, const string &file2,
                       const string &mergedFile)
@@ -40,20 +113,50 @@ void mergeEndgameFile(const string &file1, const string &file2,
                 file1.c_str(), mergedFile.c_str());
 }
 
-int mergeEndgameFile_main()
+/// EndgameFilter::EndgameFilter() makes room for the given number of keys,
+/// with a power of two number of words, and clears the filter. Past MaxWords,
+/// which holds twice the hash map, more keys only raise the false positives.
+
+EndgameFilter::EndgameFilter(size_t keyCount)
 {
-    string filename;
+    size_t n = 1;
+
+    while (n < MinWords ||
+           (n < MaxWords && n * (64 / BitsPerKey) < keyCount)) {
+        n *= 2;
+        shift--;
+    }
+
+    words = std::make_unique<std::atomic<uint64_t>[]>(n);
 
-    for (char ch = '0'; ch <= '9'; ch++) {
-        filename = ch + "/endgame.txt";
-        mergeEndgameFile("endgame.txt", filename, "endgame.txt");
+    for (size_t i = 0; i < n; i++) {
+        words[i].store(0, std::memory_order_relaxed);
     }
+}
+
+/// rebuildEndgameFilter() builds a filter sized for the keys of the endgame
+/// table and hash map, adds all of them, and then publishes it. The filter it
+/// replaces is kept until the next rebuild: a probe holds it for a few
+/// nanoseconds, while the rebuilds are games apart. A key learned while the
+/// new filter is built may be missing from it, which only costs a hit.
+
+void rebuildEndgameFilter()
+{
+    size_t keyCount = endgameTable.size();
+
+    endgameHashMap.for_each([&keyCount](Key, Endgame &) { keyCount++; });
+
+    auto filter = std::make_unique<EndgameFilter>(keyCount);
+    EndgameFilter *f = filter.get();
+
+    endgameTable.for_each_key([f](Key key) { f->add(key); });
+    endgameHashMap.for_each([f](Key key, Endgame &) { f->add(key); });
 
-#ifdef _WIN32
-    system("pause");
-#endif
+    endgameFilter.store(f, std::memory_order_release);
+    retiredFilter = std::move(liveFilter);
+    liveFilter = std::move(filter);
 
-    return 0;
+    debugPrintf("[endgame] Filter rebuilt for %zu keys\n", keyCount);
 }
 
 #endif // ENDGAME_LEARNING
@@ -21,6 +21,16 @@
 
 #ifdef ENDGAME_LEARNING
 
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "hashmap.h"
 #include "types.h"
 
@@ -28,6 +38,9 @@ using CTSL::HashMap;
 
 static const int SAVE_ENDGAME_EVERY_N_GAMES = 256;
 
+// Number of slots of the endgame hash map, also of the files it is dumped to
+static constexpr int endgameHashSize = 0x1000000; // 16M
+
 enum class EndGameType : uint32_t {
     none,
     whiteWin,
@@ -42,6 +55,206 @@ struct Endgame
 
 extern HashMap<Key, Endgame> endgameHashMap;
 
+/// EndgameTable is an immutable table of learned endgame results, built
+/// offline from the learned hash map, e.g. by the endgame-merge tool. It
+/// holds every position with its full key, so that positions whose keys
+/// collide in the hash map do not overwrite each other. The file is made of
+/// a header, an index of where the keys of each value of their top bits
+/// start, the sorted keys, and the results packed in 2 bits each. It is
+/// mapped read-only and probed without a lock.
+
+class EndgameTable
+{
+public:
+    static constexpr int IndexBits = 16;
+    static constexpr size_t IndexSize = size_t(1) << IndexBits;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t keySize;
+        uint64_t count;
+    };
+
+    static_assert(sizeof(Header) == 24, "Unexpected Header size");
+
+    static constexpr char Magic[8] = {'S', 'A', 'N', 'M', 'E', 'G', 'T', 'B'};
+    static constexpr uint32_t Version = 1;
+
+    // The keys start on an 8 byte boundary, whatever the size of Key
+    static constexpr size_t IndexBytes = (IndexSize + 1) * sizeof(uint32_t);
+    static constexpr size_t KeysOffset = (sizeof(Header) + IndexBytes + 7) /
+                                         8 * 8;
+
+    EndgameTable() = default;
+    ~EndgameTable() { unload(); }
+
+    EndgameTable(const EndgameTable &) = delete;
+    EndgameTable &operator=(const EndgameTable &) = delete;
+
+    bool load(const std::string &fname);
+    void unload();
+
+    [[nodiscard]] size_t size() const noexcept { return count; }
+
+    template <typename F>
+    void for_each_key(F f) const
+    {
+        std::for_each(keys, keys + count, f);
+    }
+
+    bool probe(Key key, Endgame &endgame) const
+    {
+        if (count == 0) {
+            return false;
+        }
+
+        const size_t b = bucket(key);
+        const Key *first = keys + index[b];
+        const Key *last = keys + index[b + 1];
+        const Key *it = std::lower_bound(first, last, key);
+
+        if (it == last || *it != key) {
+            return false;
+        }
+
+        const size_t i = static_cast<size_t>(it - keys);
+        endgame.type = static_cast<EndGameType>(results[i / 4] >> (i % 4 * 2) &
+                                                3);
+
+        return true;
+    }
+
+    // Write a table of the given entries. The first entry of a key is kept.
+    static bool write(const std::string &fname,
+                      std::vector<std::pair<Key, EndGameType>> entries)
+    {
+        std::stable_sort(entries.begin(), entries.end(),
+                         [](const auto &a, const auto &b) {
+                             return a.first < b.first;
+                         });
+        entries.erase(std::unique(entries.begin(), entries.end(),
+                                  [](const auto &a, const auto &b) {
+                                      return a.first == b.first;
+                                  }),
+                      entries.end());
+
+        Header header {};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.keySize = sizeof(Key);
+        header.count = entries.size();
+
+        std::vector<uint32_t> idx(IndexSize + 1, 0);
+        std::vector<Key> sortedKeys(entries.size());
+        std::vector<uint8_t> packed((entries.size() + 3) / 4, 0);
+
+        for (size_t i = 0; i < entries.size(); ++i) {
+            sortedKeys[i] = entries[i].first;
+            packed[i / 4] |= static_cast<uint8_t>(
+                static_cast<uint32_t>(entries[i].second) << (i % 4 * 2));
+            idx[bucket(entries[i].first) + 1]++;
+        }
+
+        for (size_t b = 0; b < IndexSize; ++b) {
+            idx[b + 1] += idx[b];
+        }
+
+        std::ofstream file(fname, std::ios::out | std::ios::binary |
+                                      std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(idx.data()),
+                   static_cast<std::streamsize>(idx.size() * sizeof(uint32_t)));
+        file.seekp(static_cast<std::streamoff>(KeysOffset));
+        file.write(reinterpret_cast<const char *>(sortedKeys.data()),
+                   static_cast<std::streamsize>(sortedKeys.size() *
+                                                sizeof(Key)));
+        file.write(reinterpret_cast<const char *>(packed.data()),
+                   static_cast<std::streamsize>(packed.size()));
+        file.close();
+
+        return static_cast<bool>(file);
+    }
+
+    static size_t file_size(uint64_t count)
+    {
+        return KeysOffset + count * sizeof(Key) + (count + 3) / 4;
+    }
+
+private:
+    static size_t bucket(Key key) noexcept
+    {
+        return static_cast<size_t>(key >> (CHAR_BIT * sizeof(Key) - IndexBits));
+    }
+
+    const void *mem {nullptr};
+    size_t memSize {0};
+    size_t count {0};
+    const uint32_t *index {nullptr};
+    const Key *keys {nullptr};
+    const uint8_t *results {nullptr};
+};
+
+extern EndgameTable endgameTable;
+
+/// EndgameFilter is a Bloom filter of the keys of the endgame table and hash
+/// map. Most positions the search meets were never learned, and the filter
+/// tells so from a few bits of a single word, which stays in the cache,
+/// instead of a random access to the large hash map. Each key sets 3 bits of
+/// one 64-bit word. A learned key is added at once, and a new filter is built
+/// to fit the store when it is loaded or saved, which drops the keys the
+/// hash map overwrote since. The new filter replaces the one endgameFilter
+/// points to, so that a search may go on probing meanwhile.
+
+class EndgameFilter
+{
+public:
+    static constexpr size_t MinWords = 16384;   // 128 KB
+    static constexpr size_t MaxWords = 1 << 23; // 64 MB
+    static constexpr size_t BitsPerKey = 16;
+
+    explicit EndgameFilter(size_t keyCount);
+
+    void add(Key key) noexcept
+    {
+        words[index(key)].fetch_or(mask(key), std::memory_order_relaxed);
+    }
+
+    [[nodiscard]] bool may_contain(Key key) const noexcept
+    {
+        const uint64_t m = mask(key);
+
+        return (words[index(key)].load(std::memory_order_relaxed) & m) == m;
+    }
+
+private:
+    static uint64_t hash(Key key) noexcept
+    {
+        return static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ULL;
+    }
+
+    [[nodiscard]] size_t index(Key key) const noexcept
+    {
+        return static_cast<size_t>(hash(key) >> shift);
+    }
+
+    static uint64_t mask(Key key) noexcept
+    {
+        const uint64_t h = hash(key);
+
+        return 1ULL << (h & 63) | 1ULL << (h >> 6 & 63) |
+               1ULL << (h >> 12 & 63);
+    }
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    int shift {64};
+};
+
+extern std::atomic<EndgameFilter *> endgameFilter;
+
+void rebuildEndgameFilter();
+
 #endif // ENDGAME_LEARNING
 
 #endif // #ifndef ENDGAME_H_INCLUDED
@@ -0,0 +1,381 @@
+// This file is part of Sanmill.
+// Copyright (C) 2019-2023 The Sanmill developers (see AUTHORS file)
+//
+// Sanmill is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Sanmill is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+/// endgame-merge merges the endgame learning files of any number of workers
+/// into one, built with 'make endgame-merge':
+///
+///   endgame-merge [-j threads] [-t table] <output> <shard>...
+///
+/// All files are dumps of the same direct-mapped hash map, so a slot of the
+/// output only depends on the same slot of every shard. The slots are split
+/// into one slice per thread, and each thread streams its slice of all the
+/// shards chunk by chunk, so that the memory used does not depend on the
+/// number of shards. Each shard is opened once and read at an offset by all
+/// the threads, so that the number of open files does not grow with them. As
+/// HashMap::merge() does, a slot keeps the entry of the first shard that has
+/// one. Shards that disagree on the result of the same key are reported.
+/// With -t, the entries of all the shards, including those lost to a
+/// collision in the output, are also written as an EndgameTable, which the
+/// engine loads from endgame.tb.
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "endgame.h"
+
+using std::string;
+using std::vector;
+
+namespace {
+
+using Node = CTSL::HashNode<Key, Endgame>;
+using Entries = vector<std::pair<Key, EndGameType>>;
+
+constexpr size_t SlotCount = endgameHashSize;
+constexpr size_t FileSize = SlotCount * sizeof(Node);
+constexpr size_t ChunkSlots = 65536; // Per thread, 512 KB for each buffer
+
+struct Counters
+{
+    uint64_t entries;    // Entries read from all the shards
+    uint64_t merged;     // Entries written to the output
+    uint64_t same;       // Entries already in the output
+    uint64_t collisions; // Entries of another key in an occupied slot
+    uint64_t conflicts;  // Entries of a key with another result
+
+    Counters &operator+=(const Counters &c)
+    {
+        entries += c.entries;
+        merged += c.merged;
+        same += c.same;
+        collisions += c.collisions;
+        conflicts += c.conflicts;
+        return *this;
+    }
+};
+
+std::mutex ioMutex;
+
+// A shard open for positioned reads, which the threads share without a lock
+
+struct Shard
+{
+    string name;
+#ifdef _WIN32
+    HANDLE fd;
+#else
+    int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+bool open_shard(Shard &shard)
+{
+    shard.fd = CreateFileA(shard.name.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                           nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS,
+                           nullptr);
+    return shard.fd != INVALID_HANDLE_VALUE;
+}
+
+void close_shard(Shard &shard)
+{
+    CloseHandle(shard.fd);
+}
+
+// read_at() reads len bytes at offset of a shard, without moving a file
+// position shared with the other threads
+
+bool read_at(const Shard &shard, void *buf, size_t len, uint64_t offset)
+{
+    OVERLAPPED ov {};
+    DWORD got = 0;
+
+    ov.Offset = static_cast<DWORD>(offset);
+    ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+
+    return ReadFile(shard.fd, buf, static_cast<DWORD>(len), &got, &ov) &&
+           got == len;
+}
+
+#else
+
+bool open_shard(Shard &shard)
+{
+    shard.fd = open(shard.name.c_str(), O_RDONLY);
+    return shard.fd != -1;
+}
+
+void close_shard(Shard &shard)
+{
+    close(shard.fd);
+}
+
+// read_at() reads len bytes at offset of a shard, without moving a file
+// position shared with the other threads
+
+bool read_at(const Shard &shard, void *buf, size_t len, uint64_t offset)
+{
+    auto *p = static_cast<char *>(buf);
+
+    while (len > 0) {
+        const ssize_t got = pread(shard.fd, p, len,
+                                  static_cast<off_t>(offset));
+
+        if (got <= 0)
+            return false;
+
+        p += got;
+        len -= static_cast<size_t>(got);
+        offset += static_cast<uint64_t>(got);
+    }
+
+    return true;
+}
+
+#endif
+
+const char *result_name(EndGameType type)
+{
+    switch (type) {
+    case EndGameType::whiteWin:
+        return "whiteWin";
+    case EndGameType::blackWin:
+        return "blackWin";
+    case EndGameType::draw:
+        return "draw";
+    default:
+        return "none";
+    }
+}
+
+// merge_slice() merges the slots [begin, end) of the shards into the output,
+// and collects the entries of the shards for the table if asked to. An entry
+// is collected when its slot is still empty or holds another key, and the
+// table keeps the first result of a key as the output does.
+
+void merge_slice(const vector<Shard> &shards, const string &output,
+                 size_t begin, size_t end, Counters &c, Entries *entries)
+{
+    std::fstream out(output, std::ios::in | std::ios::out | std::ios::binary);
+    vector<Node> merged(ChunkSlots);
+    vector<Node> chunk(ChunkSlots);
+    vector<size_t> origin(ChunkSlots);
+
+    for (size_t slot = begin; slot < end; slot += ChunkSlots) {
+        const size_t n = std::min(ChunkSlots, end - slot);
+        const auto offset = static_cast<std::streamoff>(slot * sizeof(Node));
+        const auto len = static_cast<std::streamsize>(n * sizeof(Node));
+
+        std::fill_n(merged.begin(), n, Node());
+
+        for (size_t f = 0; f < shards.size(); ++f) {
+            if (!read_at(shards[f], chunk.data(), static_cast<size_t>(len),
+                         static_cast<uint64_t>(offset))) {
+                std::lock_guard<std::mutex> lock(ioMutex);
+                std::cerr << "Read error in " << shards[f].name << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            for (size_t i = 0; i < n; ++i) {
+                Node &node = chunk[i];
+                Node &m = merged[i];
+
+                if (node.getKey() == 0)
+                    continue;
+
+                c.entries++;
+
+                if (entries && m.getKey() != node.getKey())
+                    entries->emplace_back(node.getKey(),
+                                          node.getValue().type);
+
+                if (m.getKey() == 0) {
+                    m = node;
+                    origin[i] = f;
+                    c.merged++;
+                } else if (m.getKey() != node.getKey()) {
+                    c.collisions++;
+                } else if (m.getValue().type == node.getValue().type) {
+                    c.same++;
+                } else {
+                    c.conflicts++;
+
+                    std::lock_guard<std::mutex> lock(ioMutex);
+                    std::cout << "conflict key 0x" << std::hex
+                              << static_cast<uint64_t>(node.getKey())
+                              << std::dec << " "
+                              << result_name(m.getValue().type) << " in "
+                              << shards[origin[i]].name << ", "
+                              << result_name(node.getValue().type) << " in "
+                              << shards[f].name << std::endl;
+                }
+            }
+        }
+
+        out.seekp(offset);
+        out.write(reinterpret_cast<const char *>(merged.data()), len);
+    }
+
+    if (!out) {
+        std::lock_guard<std::mutex> lock(ioMutex);
+        std::cerr << "Write error in " << output << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    size_t threadCount = std::max(std::thread::hardware_concurrency(), 1U);
+    string table;
+    int i = 1;
+
+    for (; i + 1 < argc; i += 2) {
+        if (string(argv[i]) == "-j")
+            threadCount = std::max(std::atoi(argv[i + 1]), 1);
+        else if (string(argv[i]) == "-t")
+            table = argv[i + 1];
+        else
+            break;
+    }
+
+    if (argc - i < 2) {
+        std::cerr << "Usage: " << argv[0]
+                  << " [-j threads] [-t table] <output> <shard>..."
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Written next to the output and renamed at the end, so that the output
+    // may also be one of the shards
+    const string output = argv[i++];
+    const string temp = output + ".tmp";
+    vector<Shard> shards;
+
+    for (; i < argc; ++i) {
+        std::ifstream file(argv[i], std::ios::in | std::ios::binary |
+                                        std::ios::ate);
+        Shard shard {argv[i], {}};
+
+        if (!file || file.tellg() != static_cast<std::streamoff>(FileSize)) {
+            std::cerr << "Skipping " << argv[i] << ": not an endgame file of "
+                      << FileSize << " bytes" << std::endl;
+            continue;
+        }
+
+        if (!open_shard(shard)) {
+            std::cerr << "Skipping " << argv[i] << ": cannot open it"
+                      << std::endl;
+            continue;
+        }
+
+        shards.push_back(shard);
+    }
+
+    if (shards.empty()) {
+        std::cerr << "No endgame file to merge" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    {
+        std::ofstream file(temp, std::ios::out | std::ios::binary |
+                                     std::ios::trunc);
+        file.seekp(FileSize - 1);
+        file.put('\0');
+
+        if (!file) {
+            std::cerr << "Cannot create " << temp << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Slices of whole chunks, one per thread
+    const size_t chunks = (SlotCount + ChunkSlots - 1) / ChunkSlots;
+    threadCount = std::min(threadCount, chunks);
+    vector<Counters> counters(threadCount, Counters {});
+    vector<Entries> entries(threadCount);
+    vector<std::thread> threads;
+
+    for (size_t t = 0; t < threadCount; ++t) {
+        const size_t begin = chunks * t / threadCount * ChunkSlots;
+        const size_t end = std::min(chunks * (t + 1) / threadCount *
+                                        ChunkSlots,
+                                    SlotCount);
+
+        threads.emplace_back(merge_slice, std::cref(shards), std::cref(temp),
+                             begin, end, std::ref(counters[t]),
+                             table.empty() ? nullptr : &entries[t]);
+    }
+
+    Counters total {};
+
+    for (size_t t = 0; t < threadCount; ++t) {
+        threads[t].join();
+        total += counters[t];
+    }
+
+    for (Shard &shard : shards)
+        close_shard(shard);
+
+#ifdef _WIN32
+    std::remove(output.c_str()); // rename() does not replace a file there
+#endif
+
+    if (std::rename(temp.c_str(), output.c_str())) {
+        std::cerr << "Cannot rename " << temp << " to " << output << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!table.empty()) {
+        Entries all;
+
+        for (Entries &e : entries)
+            all.insert(all.end(), e.begin(), e.end());
+
+        if (!EndgameTable::write(table, std::move(all))) {
+            std::cerr << "Cannot write " << table << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << "shards " << shards.size() << " entries " << total.entries
+              << " merged " << total.merged << " same " << total.same
+              << " collisions " << total.collisions << " conflicts "
+              << total.conflicts << " used "
+              << total.merged * 100 / SlotCount << "%" << std::endl;
+
+    return 0;
+}
@@ -19,6 +19,7 @@
 
 #include "config.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <cstring>
 #include <fstream>
@@ -59,32 +60,10 @@ public:
     explicit HashMap(hashFn hashSize_ = HASH_SIZE_DEFAULT)
         : hashSize(hashSize_)
     {
-#ifdef DISABLE_HASHBUCKET
-#ifdef ALIGNED_LARGE_PAGES
-        hashTable = (HashNode<K, V> *)aligned_large_pages_alloc(
-            sizeof(HashNode<K, V>) * hashSize);
-#else  // ALIGNED_LARGE_PAGES
-
-        // Create the key table as an array of key nodes
-        hashTable = new HashNode<K, V>[hashSize];
-#endif // ALIGNED_LARGE_PAGES
-
-        memset(hashTable, 0, sizeof(HashNode<K, V>) * hashSize);
-#else  // DISABLE_HASHBUCKET
-       // create the key table as an array of key buckets
-        hashTable = new HashBucket<K, V>[hashSize];
-#endif // DISABLE_HASHBUCKET
+        allocate();
     }
 
-    ~HashMap()
-    {
-#ifdef ALIGNED_LARGE_PAGES
-        aligned_large_pages_free(hashTable);
-#else  // ALIGNED_LARGE_PAGES
-
-        delete[] hashTable;
-#endif // ALIGNED_LARGE_PAGES
-    }
+    ~HashMap() { deallocate(); }
 
     // Copy and Move of the HashMap are not supported at this moment
     HashMap(const HashMap &) = delete;
@@ -173,19 +152,34 @@ public:
 #endif // DISABLE_HASHBUCKET
     }
 
-    void resize(size_t size)
+    // Function to call f(key, value) on every entry of the key map
+    template <typename F>
+    void for_each(F f) const
     {
-        // TODO(calcitem): Resize
-        if (size < 0x1000000) {
-            // New size is too small, do not resize
-            return;
+#ifdef DISABLE_HASHBUCKET
+        for (size_t i = 0; i < hashSize; i++) {
+            if (hashTable[i].getKey() != 0) {
+                f(hashTable[i].getKey(), hashTable[i].getValue());
+            }
         }
+#endif // DISABLE_HASHBUCKET
+    }
+
+    // Function to reallocate the key map with the given number of entries,
+    // which must be a power of two. All entries are discarded.
+    void resize(size_t size)
+    {
+        assert(size && !(size & (size - 1)));
+
+        deallocate();
 
 #ifdef TRANSPOSITION_TABLE_64BIT_KEY
         hashSize = size;
 #else  // TRANSPOSITION_TABLE_64BIT_KEY
         hashSize = static_cast<uint32_t>(size);
 #endif // TRANSPOSITION_TABLE_64BIT_KEY
+
+        allocate();
     }
 
     // Function to dump the key map to file
@@ -193,24 +187,44 @@ public:
     {
 #ifdef DISABLE_HASHBUCKET
         std::ofstream file;
-        file.open(filename, std::ios::out);
-        file.write(static_cast<char *>(hashTable),
+        file.open(filename, std::ios::out | std::ios::binary);
+        file.write(reinterpret_cast<char *>(hashTable),
                    sizeof(HashNode<K, V>) * hashSize);
         file.close();
 #endif // DISABLE_HASHBUCKET
     }
 
-    // Function to load the key map from file
+    // Function to load the key map from file. A file of another size than
+    // the map is rejected, and one that cannot be read in full leaves the map
+    // empty.
     void load(const std::string &filename) const
     {
 #ifdef DISABLE_HASHBUCKET
+        const auto size = static_cast<std::streamoff>(sizeof(HashNode<K, V>) *
+                                                      hashSize);
         std::ifstream file;
-        file.open(filename, std::ios::in);
-        file.read(static_cast<char *>(hashTable),
-                  sizeof(HashNode<K, V>) * hashSize);
+        file.open(filename, std::ios::in | std::ios::binary | std::ios::ate);
+
+        if (!file || file.tellg() != size) {
+            debugPrintf("Hash map file %s rejected: size mismatch\n",
+                        filename.c_str());
+            return;
+        }
+
+        file.seekg(0);
+        file.read(reinterpret_cast<char *>(hashTable), size);
+
+        if (!file) {
+            memset(hashTable, 0, static_cast<size_t>(size));
+            debugPrintf("Hash map file %s rejected: read error\n",
+                        filename.c_str());
+            return;
+        }
+
         file.close();
 
-        stat();
+        debugPrintf("Hash map loaded from file (%d%% used)\n",
+                    hashfull() / 10);
 #endif // DISABLE_HASHBUCKET
     }
 
@@ -233,25 +247,19 @@ public:
 
         for (size_t i = 0; i < hashSize; i++) {
             const size_t offset = i * nsize;
-            if (memcmp(static_cast<char *>(other.hashTable) + offset, empty,
-                       ksize)) {
+            char *dst = reinterpret_cast<char *>(hashTable) + offset;
+            const char *src = reinterpret_cast<char *>(other.hashTable) +
+                              offset;
+            if (memcmp(src, empty, ksize)) {
                 nProcessed++;
-                if (!memcmp(static_cast<char *>(hashTable) + offset, empty,
-                            ksize)) {
-                    memcpy(static_cast<char *>(hashTable) + offset,
-                           static_cast<char *>(other.hashTable) + offset,
-                           nsize);
+                if (!memcmp(dst, empty, ksize)) {
+                    memcpy(dst, src, nsize);
                     nMerged++;
                 } else {
                     nSkip++;
-                    if (!memcmp(static_cast<char *>(other.hashTable) + offset,
-                                static_cast<char *>(hashTable) + offset,
-                                nsize)) {
+                    if (!memcmp(src, dst, nsize)) {
                         nAllSame++;
-                    } else if (!memcmp(static_cast<char *>(other.hashTable) +
-                                           offset,
-                                       static_cast<char *>(hashTable) + offset,
-                                       ksize)) {
+                    } else if (!memcmp(src, dst, ksize)) {
                         nOnlyKeySame++;
                     } else {
                         nDiff++;
@@ -283,19 +291,72 @@ public:
         memset(empty, 0, size);
 
         for (size_t i = 0; i < hashSize; i++) {
-            if (memcmp(static_cast<char *>(hashTable) + i * size, empty,
+            if (memcmp(reinterpret_cast<char *>(hashTable) + i * size, empty,
                        size)) {
                 nEntries++;
             }
         }
 
-        debugPrintf("Hash map loaded from file (%lld/%d entries)\n", nEntries,
-                    hashSize);
+        debugPrintf("Hash map holds %lld/%d entries\n", nEntries, hashSize);
 
         return nEntries;
     }
 
+    // Estimate of the share of nodes in use, in per mille. Only the first
+    // nodes are looked at: the keys spread evenly over the whole table, so
+    // there is no need to scan all of it as stat() does.
+    [[nodiscard]] int hashfull() const
+    {
+        constexpr size_t Samples = 1000;
+        const size_t n = std::min(static_cast<size_t>(hashSize), Samples);
+        const size_t size = sizeof(HashNode<K, V>);
+        char empty[sizeof(HashNode<K, V>)];
+        memset(empty, 0, size);
+
+        size_t nEntries = 0;
+
+        for (size_t i = 0; i < n; i++) {
+            if (memcmp(reinterpret_cast<char *>(hashTable) + i * size, empty,
+                       size)) {
+                nEntries++;
+            }
+        }
+
+        return n ? static_cast<int>(nEntries * 1000 / n) : 0;
+    }
+
 private:
+    // Function to allocate an empty key table of hashSize entries
+    void allocate()
+    {
+#ifdef DISABLE_HASHBUCKET
+#ifdef ALIGNED_LARGE_PAGES
+        hashTable = (HashNode<K, V> *)aligned_large_pages_alloc(
+            sizeof(HashNode<K, V>) * hashSize);
+#else  // ALIGNED_LARGE_PAGES
+
+        // Create the key table as an array of key nodes
+        hashTable = new HashNode<K, V>[hashSize];
+#endif // ALIGNED_LARGE_PAGES
+
+        memset(hashTable, 0, sizeof(HashNode<K, V>) * hashSize);
+#else  // DISABLE_HASHBUCKET
+       // create the key table as an array of key buckets
+        hashTable = new HashBucket<K, V>[hashSize];
+#endif // DISABLE_HASHBUCKET
+    }
+
+    // Function to release the key table
+    void deallocate()
+    {
+#if defined(DISABLE_HASHBUCKET) && defined(ALIGNED_LARGE_PAGES)
+        aligned_large_pages_free(hashTable);
+#else  // DISABLE_HASHBUCKET && ALIGNED_LARGE_PAGES
+        delete[] hashTable;
+#endif // DISABLE_HASHBUCKET && ALIGNED_LARGE_PAGES
+        hashTable = nullptr;
+    }
+
 #ifdef DISABLE_HASHBUCKET
     HashNode<K, V> *hashTable;
 #else  // DISABLE_HASHBUCKET
@@ -49,6 +49,13 @@ using fun3_t = bool (*)(HANDLE, CONST GROUP_AFFINITY *, PGROUP_AFFINITY);
 #include <sys/mman.h>
 #endif
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #if defined(__APPLE__) || defined(__ANDROID__) || defined(__OpenBSD__) || \
     (defined(__GLIBCXX__) && !defined(_GLIBCXX_HAVE_ALIGNED_ALLOC) && \
      !defined(_WIN32))
@@ -410,8 +417,6 @@ void std_aligned_free(void *ptr)
 #endif
 }
 
-#ifdef ALIGNED_LARGE_PAGES
-
 /// aligned_large_pages_alloc() will return suitably aligned memory, if possible
 /// using large pages.
 
@@ -522,7 +527,81 @@ void aligned_large_pages_free(void *mem)
 }
 
 #endif
-#endif // ALIGNED_LARGE_PAGES
+
+/// map_file() maps a whole file read-only into memory and sets its size. The
+/// pages are only read from disk, or from the page cache, once touched. The
+/// mapping must be released with unmap_file().
+
+#if defined(_WIN32)
+
+const void *map_file(const std::string &fname, size_t &size)
+{
+    const HANDLE fd = CreateFileA(fname.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                  nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_RANDOM_ACCESS, nullptr);
+
+    if (fd == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    LARGE_INTEGER fileSize;
+    const HANDLE mmap = GetFileSizeEx(fd, &fileSize) && fileSize.QuadPart ?
+                            CreateFileMapping(fd, nullptr, PAGE_READONLY, 0, 0,
+                                              nullptr) :
+                            nullptr;
+    CloseHandle(fd);
+
+    if (!mmap)
+        return nullptr;
+
+    const void *mem = MapViewOfFile(mmap, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mmap); // The view keeps the mapping alive
+    size = static_cast<size_t>(fileSize.QuadPart);
+
+    return mem;
+}
+
+void unmap_file(const void *mem, size_t)
+{
+    if (mem)
+        UnmapViewOfFile(mem);
+}
+
+#else
+
+const void *map_file(const std::string &fname, size_t &size)
+{
+    const int fd = open(fname.c_str(), O_RDONLY);
+
+    if (fd == -1)
+        return nullptr;
+
+    struct stat statbuf {};
+    void *mem = MAP_FAILED;
+
+    if (fstat(fd, &statbuf) == 0 && statbuf.st_size > 0) {
+        size = static_cast<size_t>(statbuf.st_size);
+        mem = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+
+    close(fd); // The mapping keeps the file alive
+
+    if (mem == MAP_FAILED)
+        return nullptr;
+
+#if defined(MADV_SEQUENTIAL)
+    madvise(mem, size, MADV_SEQUENTIAL);
+#endif
+
+    return mem;
+}
+
+void unmap_file(const void *mem, size_t size)
+{
+    if (mem)
+        munmap(const_cast<void *>(mem), size);
+}
+
+#endif
 
 #ifdef _WIN32
 #include <direct.h>
@@ -33,13 +33,15 @@ void prefetch_range(void *addr, size_t len);
 void start_logger(const std::string &fname);
 void *std_aligned_alloc(size_t alignment, size_t size);
 void std_aligned_free(void *ptr);
-#ifdef ALIGNED_LARGE_PAGES
 // memory aligned by page size, min alignment: 4096 bytes
 void *aligned_large_pages_alloc(size_t allocSize);
 
 // nop if mem == nullptr
 void aligned_large_pages_free(void *mem);
-#endif // ALIGNED_LARGE_PAGES
+
+// read-only mapping of a whole file, nullptr if it cannot be opened or mapped
+const void *map_file(const std::string &fname, size_t &size);
+void unmap_file(const void *mem, size_t size);
 
 void dbg_hit_on(bool b) noexcept;
 void dbg_hit_on(bool c, bool b) noexcept;
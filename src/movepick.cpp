@@ -14,6 +14,9 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <cstdlib>
+
 #include "movepick.h"
 
 // partial_insertion_sort() sorts moves in descending order up to and including
@@ -30,135 +33,334 @@ void partial_insertion_sort(ExtMove *begin, const ExtMove *end, int limit)
         }
 }
 
+/// HistoryTable::update() adds a bonus, or a malus if negative, to the entry
+/// of a move. The more the entry already agrees with the bonus, the less the
+/// bonus counts, which keeps the entry within [-HistoryMax, HistoryMax].
+void HistoryTable::update(Color c, Move m, int bonus) noexcept
+{
+    int16_t &entry = table[c][index_from(m)][to_sq(m)];
+
+    bonus = std::clamp(bonus, -HistoryMax, HistoryMax);
+    entry += static_cast<int16_t>(bonus - entry * std::abs(bonus) / HistoryMax);
+
+    assert(std::abs(entry) <= HistoryMax);
+}
+
 /// Constructors of the MovePicker class.
 
-/// MovePicker constructor for the main search
+/// MovePicker constructor for the main search. The TT move is tried first,
+/// if it is valid in the position, before the other moves are generated.
+/// The killer moves of the ply and the history of the searching thread, if
+/// given, order the moves that neither close nor block a mill, and the
+/// removals respectively.
+MovePicker::MovePicker(Position &p, Move ttm, const Move *killers_,
+                       const HistoryTable *history_) noexcept
+    : pos(p)
+    , history(history_)
+    , ttMove(ttm)
+{
+    // Killers only pay off in the placing phase. In the moving phase the
+    // order of the generator does better.
+    if (killers_ != nullptr && pos.get_phase() == Phase::placing) {
+        killers[0] = killers_[0];
+        killers[1] = killers_[1];
+    }
+
+    stage = ttm != MOVE_NONE && pos.pseudo_legal(ttm) ? TT_STAGE : INIT_STAGE;
+
+    if (stage == INIT_STAGE) {
+        ttMove = MOVE_NONE;
+    }
+}
+
+/// MovePicker constructor for the quiescence search, which only tries the
+/// removals, or else the moves closing a mill.
 MovePicker::MovePicker(Position &p) noexcept
     : pos(p)
+    , stage(INIT_STAGE)
+    , quiescence(true)
 { }
 
-/// MovePicker::score() assigns a numerical value to each move in a list, used
-/// for sorting.
-template <GenType Type>
-void MovePicker::score()
+/// MovePicker::mill_score() rates a place or move by the number of mills it
+/// closes. If the board has diagonal lines, black's second piece on a star
+/// square is as good as a mill.
+int MovePicker::mill_score(Move m)
 {
-    cur = moves;
+    int value = RATING_ZERO;
+
+#ifndef SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
+    // if stat before moving, moving phrase maybe from @-0-@ to 0-@-@, but
+    // no mill, so need |from| to judge
+    const int ourMillsCount = pos.potential_mills_count(
+        to_sq(m), pos.side_to_move(), from_sq(m));
+
+    // TODO(calcitem): rule.mayRemoveMultiple adapt other rules
+    value += RATING_ONE_MILL * ourMillsCount;
+
+    // If has Diagonal Lines, black 2nd move place star point is as
+    // important as close mill (TODO)
+    if (rule.hasDiagonalLines &&
+        pos.count<ON_BOARD>(BLACK) < 2 && // patch: only when black 2nd move
+        Position::is_star_square(static_cast<Square>(m))) {
+        value += RATING_STAR_SQUARE;
+    }
+#endif // !SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
+
+    return value;
+}
+
+/// MovePicker::block_score() rates a place or move by the number of mills of
+/// the opponent it blocks.
+int MovePicker::block_score(Move m)
+{
+    int value = RATING_ZERO;
+
+#ifndef SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
+    const Square to = to_sq(m);
+    const int theirMillsCount = pos.potential_mills_count(
+        to, ~pos.side_to_move());
+
+    if (pos.get_phase() == Phase::placing) {
+        // placing phrase, check if place sq can block their close mill
+        value += RATING_BLOCK_ONE_MILL * theirMillsCount;
+    } else if (pos.get_phase() == Phase::moving && theirMillsCount) {
+        // moving phrase, check if place sq can block their close mill
+        int ourPieceCount = 0;
+        int theirPiecesCount = 0;
+        int bannedCount = 0;
+        int emptyCount = 0;
 
-    int theirMillsCount;
+        pos.surrounded_pieces_count(to, ourPieceCount, theirPiecesCount,
+                                    bannedCount, emptyCount);
+
+        if (to % 2 == 0 && theirPiecesCount == 3) {
+            value += RATING_BLOCK_ONE_MILL * theirMillsCount;
+        } else if (to % 2 == 1 && theirPiecesCount == 2 &&
+                   rule.hasDiagonalLines) {
+            value += RATING_BLOCK_ONE_MILL * theirMillsCount;
+        }
+    }
+#endif // !SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
+
+    return value;
+}
+
+/// MovePicker::remove_score() rates the removal of a piece of the opponent.
+int MovePicker::remove_score(Move m)
+{
+    int value = RATING_ZERO;
+
+#ifndef SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
+    const Square to = to_sq(m);
     int ourPieceCount = 0;
     int theirPiecesCount = 0;
     int bannedCount = 0;
     int emptyCount = 0;
 
-    while (cur++->move != MOVE_NONE) {
-        Move m = cur->move;
-
-        const Square to = to_sq(m);
-        const Square from = from_sq(m);
+    pos.surrounded_pieces_count(to, ourPieceCount, theirPiecesCount,
+                                bannedCount, emptyCount);
 
-        // if stat before moving, moving phrase maybe from @-0-@ to 0-@-@, but
-        // no mill, so need |from| to judge
-        const int ourMillsCount = pos.potential_mills_count(
-            to, pos.side_to_move(), from);
+    if (pos.potential_mills_count(to, pos.side_to_move()) > 0) {
+        // remove point is in our mill
+        // value += RATING_REMOVE_ONE_MILL * ourMillsCount;
 
-#ifndef SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
-        // TODO(calcitem): rule.mayRemoveMultiple adapt other rules
-        if (type_of(m) != MOVETYPE_REMOVE) {
-            // all phrase, check if place sq can close mill
-            if (ourMillsCount > 0) {
-                cur->value += RATING_ONE_MILL * ourMillsCount;
-            } else if (pos.get_phase() == Phase::placing) {
-                // placing phrase, check if place sq can block their close mill
-                theirMillsCount = pos.potential_mills_count(
-                    to, ~pos.side_to_move());
-                cur->value += RATING_BLOCK_ONE_MILL * theirMillsCount;
-            } else if (pos.get_phase() == Phase::moving) {
-                // moving phrase, check if place sq can block their close mill
-                theirMillsCount = pos.potential_mills_count(
-                    to, ~pos.side_to_move());
-
-                if (theirMillsCount) {
-                    ourPieceCount = theirPiecesCount = bannedCount =
-                        emptyCount = 0;
-
-                    pos.surrounded_pieces_count(to, ourPieceCount,
-                                                theirPiecesCount, bannedCount,
-                                                emptyCount);
-
-                    if (to % 2 == 0 && theirPiecesCount == 3) {
-                        cur->value += RATING_BLOCK_ONE_MILL * theirMillsCount;
-                    } else if (to % 2 == 1 && theirPiecesCount == 2 &&
-                               rule.hasDiagonalLines) {
-                        cur->value += RATING_BLOCK_ONE_MILL * theirMillsCount;
-                    }
-                }
+        if (theirPiecesCount == 0) {
+            // if remove point nearby has no their piece, preferred.
+            value += 1;
+            if (ourPieceCount > 0) {
+                // if remove point nearby our piece, preferred
+                value += ourPieceCount;
             }
+        }
+    }
 
-            // cur->value += bannedCount;  // placing phrase, place nearby ban
-            // point
+    // remove point is in their mill
+    if (pos.potential_mills_count(to, ~pos.side_to_move())) {
+        if (theirPiecesCount >= 2) {
+            // if nearby their piece, prefer do not remove
+            value -= theirPiecesCount;
 
-            // If has Diagonal Lines, black 2nd move place star point is as
-            // important as close mill (TODO)
-            if (rule.hasDiagonalLines &&
-                pos.count<ON_BOARD>(BLACK) < 2 && // patch: only when black 2nd
-                // move
-                Position::is_star_square(static_cast<Square>(m))) {
-                cur->value += RATING_STAR_SQUARE;
-            }
-        } else {
-            // Remove
-            ourPieceCount = theirPiecesCount = bannedCount = emptyCount = 0;
-
-            pos.surrounded_pieces_count(to, ourPieceCount, theirPiecesCount,
-                                        bannedCount, emptyCount);
-
-            if (ourMillsCount > 0) {
-                // remove point is in our mill
-                // cur->value += RATING_REMOVE_ONE_MILL * ourMillsCount;
-
-                if (theirPiecesCount == 0) {
-                    // if remove point nearby has no their piece, preferred.
-                    cur->value += 1;
-                    if (ourPieceCount > 0) {
-                        // if remove point nearby our piece, preferred
-                        cur->value += ourPieceCount;
-                    }
-                }
+            if (ourPieceCount == 0) {
+                // if nearby has no our piece, more prefer do not remove
+                value -= 1;
             }
+        }
+    }
 
-            // remove point is in their mill
-            theirMillsCount = pos.potential_mills_count(to,
-                                                        ~pos.side_to_move());
-            if (theirMillsCount) {
-                if (theirPiecesCount >= 2) {
-                    // if nearby their piece, prefer do not remove
-                    cur->value -= theirPiecesCount;
-
-                    if (ourPieceCount == 0) {
-                        // if nearby has no our piece, more prefer do not remove
-                        cur->value -= 1;
-                    }
-                }
-            }
+    // prefer remove piece that mobility is strong
+    value += emptyCount;
+#endif // !SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
+
+    return value;
+}
 
-            // prefer remove piece that mobility is strong
-            cur->value += emptyCount;
+/// MovePicker::select() returns the first move with the highest value among
+/// the moves left that satisfy the filter, or MOVE_NONE. The move is rotated
+/// to the front, so that the others keep the order the generator gave them.
+template <typename Pred>
+Move MovePicker::select(Pred filter)
+{
+    ExtMove *best = nullptr;
+
+    for (ExtMove *m = cur; m < endMoves; ++m) {
+        if (m->move != ttMove && filter(*m) &&
+            (best == nullptr || m->value > best->value)) {
+            best = m;
         }
-#endif // !SORT_MOVE_WITHOUT_HUMAN_KNOWLEDGE
     }
+
+    if (best == nullptr) {
+        return MOVE_NONE;
+    }
+
+    std::rotate(cur, best, best + 1);
+
+    return cur++->move;
 }
 
-/// MovePicker::next_move() is the most important method of the MovePicker
-/// class. It returns a new pseudo legal move every time it is called until
-/// there are no more moves left, picking the move with the highest score from a
-/// list of generated moves.
-Move MovePicker::next_move()
+/// MovePicker::generate_moves() generates, scores and sorts all the moves.
+/// The root uses it to see all its moves up front, the TT move is sorted
+/// first then.
+void MovePicker::generate_moves()
 {
     endMoves = generate<LEGAL>(pos, moves);
     moveCount = static_cast<int>(endMoves - moves);
 
-    score<LEGAL>();
+    for (ExtMove *m = moves; m < endMoves; ++m) {
+        if (m->move == ttMove) {
+            m->value = INT_MAX;
+        } else if (pos.get_action() == Action::remove) {
+            m->value = remove_score(m->move);
+        } else {
+            const int millValue = mill_score(m->move);
+            m->value = millValue > 0 ? millValue : block_score(m->move);
+        }
+    }
+
     partial_insertion_sort(moves, endMoves, INT_MIN);
 
-    return *moves;
+    cur = moves;
+    ttMove = MOVE_NONE;
+    stage = ROOT_STAGE;
+}
+
+/// MovePicker::exclude() drops the given moves from the generated moves,
+/// keeping the order of the others. MultiPV searches the root once per line
+/// without the moves of the lines already found.
+void MovePicker::exclude(const Move *first, const Move *last)
+{
+    endMoves = std::remove_if(moves, endMoves, [=](const ExtMove &m) {
+        return std::find(first, last, m.move) != last;
+    });
+    moveCount = static_cast<int>(endMoves - moves);
+}
+
+/// MovePicker::next_move() is the most important method of the MovePicker
+/// class. It returns a new pseudo legal move every time it is called until
+/// there are no more moves left, when MOVE_NONE is returned. The moves are
+/// tried in stages, and each stage only scores what it needs, since most
+/// nodes cut off after the first move or two: the TT move first, then the
+/// moves closing a mill, then those blocking a mill of the opponent, then the
+/// killer moves, then the rest. Removals are a stage of their own.
+Move MovePicker::next_move()
+{
+    Move move;
+
+    switch (stage) {
+    case TT_STAGE:
+        ++stage;
+        return ttMove;
+
+    case INIT_STAGE:
+        endMoves = generate<LEGAL>(pos, moves);
+        moveCount = static_cast<int>(endMoves - moves);
+        cur = moves;
+
+        if (pos.get_action() == Action::remove) {
+            // The history only breaks ties between the static ratings
+            for (ExtMove *m = moves; m < endMoves; ++m) {
+                m->value = remove_score(m->move) *
+                           (2 * HistoryTable::HistoryMax + 1);
+                if (history != nullptr) {
+                    m->value += history->get(pos.side_to_move(), m->move);
+                }
+            }
+
+            stage = REMOVE_STAGE;
+            return next_move();
+        }
+
+        for (ExtMove *m = moves; m < endMoves; ++m) {
+            m->value = mill_score(m->move);
+        }
+
+        ++stage;
+        [[fallthrough]];
+
+    case MILL_STAGE:
+        move = select([](const ExtMove &m) { return m.value > 0; });
+        if (move != MOVE_NONE) {
+            return move;
+        }
+
+        if (quiescence) {
+            return MOVE_NONE;
+        }
+
+        ++stage;
+        [[fallthrough]];
+
+    case BLOCK_INIT_STAGE:
+        for (ExtMove *m = cur; m < endMoves; ++m) {
+            m->value = block_score(m->move);
+        }
+
+        ++stage;
+        [[fallthrough]];
+
+    case BLOCK_STAGE:
+        move = select([](const ExtMove &m) { return m.value > 0; });
+        if (move != MOVE_NONE) {
+            return move;
+        }
+
+        ++stage;
+        [[fallthrough]];
+
+    case KILLER_STAGE:
+        // Killers from another position at the same ply are only tried if
+        // they were generated here
+        move = select([this](const ExtMove &m) {
+            return m.move == killers[0] || m.move == killers[1];
+        });
+        if (move != MOVE_NONE) {
+            return move;
+        }
+
+        ++stage;
+        [[fallthrough]];
+
+    case QUIET_STAGE:
+        while (cur < endMoves) {
+            if (cur->move != ttMove) {
+                return cur++->move;
+            }
+            ++cur;
+        }
+        break;
+
+    case REMOVE_STAGE:
+        return select([](const ExtMove &) { return true; });
+
+    case ROOT_STAGE:
+        if (cur < endMoves) {
+            return cur++->move;
+        }
+        break;
+
+    default:
+        assert(false);
+    }
+
+    return MOVE_NONE;
 }
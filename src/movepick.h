@@ -18,6 +18,7 @@
 #define MOVEPICK_H_INCLUDED
 
 #include <array>
+#include <cstring>
 #include <limits>
 #include <type_traits>
 
@@ -30,6 +31,33 @@ struct ExtMove;
 
 void partial_insertion_sort(ExtMove *begin, const ExtMove *end, int limit);
 
+/// HistoryTable records how well each move of each side did in the search,
+/// indexed by side to move, from square and to square. A place has no from
+/// square, and a remove is recorded with its square as both from and to
+/// square. Entries are kept within [-HistoryMax, HistoryMax].
+class HistoryTable
+{
+public:
+    static constexpr int HistoryMax = 8192;
+
+    [[nodiscard]] int get(Color c, Move m) const noexcept
+    {
+        return table[c][index_from(m)][to_sq(m)];
+    }
+
+    void update(Color c, Move m, int bonus) noexcept;
+
+    void clear() noexcept { std::memset(table, 0, sizeof(table)); }
+
+private:
+    static Square index_from(Move m) noexcept
+    {
+        return type_of(m) == MOVETYPE_REMOVE ? to_sq(m) : from_sq(m);
+    }
+
+    int16_t table[COLOR_NB][SQUARE_EXT_NB][SQUARE_EXT_NB];
+};
+
 /// MovePicker class is used to pick one pseudo legal move at a time from the
 /// current position. The most important method is next_move(), which returns a
 /// new pseudo legal move each time it is called, until there are no moves left,
@@ -38,29 +66,59 @@ void partial_insertion_sort(ExtMove *begin, const ExtMove *end, int limit);
 /// likely to get a cut-off first.
 class MovePicker
 {
+    enum Stages {
+        TT_STAGE,
+        INIT_STAGE,
+        MILL_STAGE,
+        BLOCK_INIT_STAGE,
+        BLOCK_STAGE,
+        KILLER_STAGE,
+        QUIET_STAGE,
+        REMOVE_STAGE,
+        ROOT_STAGE
+    };
+
+    int mill_score(Move m);
+    int block_score(Move m);
+    int remove_score(Move m);
+
+    template <typename Pred>
+    Move select(Pred filter);
+
 public:
     MovePicker(const MovePicker &) = delete;
     MovePicker &operator=(const MovePicker &) = delete;
+    MovePicker(Position &p, Move ttm, const Move *killers = nullptr,
+               const HistoryTable *history = nullptr) noexcept;
     explicit MovePicker(Position &p) noexcept;
 
     Move next_move();
-
-    template <GenType>
-    void score();
+    void generate_moves();
+    void exclude(const Move *first, const Move *last);
 
     [[nodiscard]] ExtMove *begin() const noexcept { return cur; }
 
     [[nodiscard]] ExtMove *end() const noexcept { return endMoves; }
 
     Position &pos;
+    const HistoryTable *history {nullptr};
     Move ttMove {MOVE_NONE};
+    Move killers[2] {MOVE_NONE, MOVE_NONE};
     ExtMove *cur {nullptr};
     ExtMove *endMoves {nullptr};
-    ExtMove moves[MAX_MOVES] {{MOVE_NONE, 0}};
+    ExtMove moves[MAX_MOVES];
 
+    int stage {TT_STAGE};
     int moveCount {0};
+    bool quiescence {false};
 
     [[nodiscard]] int move_count() const noexcept { return moveCount; }
+
+    // Whether the last move returned neither closes nor blocks a mill
+    [[nodiscard]] bool quiet_stage() const noexcept
+    {
+        return stage == KILLER_STAGE || stage == QUIET_STAGE;
+    }
 };
 
 #endif // #ifndef MOVEPICK_H_INCLUDED
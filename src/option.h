@@ -202,6 +202,44 @@ public:
 
     [[nodiscard]] int getAlgorithm() const noexcept { return algorithm; }
 
+    // Aspiration windows, for Alpha-Beta and PVS
+
+    void setAspirationWindow(bool enabled) noexcept
+    {
+        aspirationWindow = enabled;
+    }
+
+    [[nodiscard]] bool getAspirationWindow() const noexcept
+    {
+        return aspirationWindow;
+    }
+
+    // Late move reductions, for the moving phase
+
+    void setLateMoveReduction(bool enabled) noexcept
+    {
+        lateMoveReduction = enabled;
+    }
+
+    [[nodiscard]] bool getLateMoveReduction() const noexcept
+    {
+        return lateMoveReduction;
+    }
+
+    void setLmrMinDepth(int depth) noexcept { lmrMinDepth = depth; }
+
+    [[nodiscard]] int getLmrMinDepth() const noexcept { return lmrMinDepth; }
+
+    void setLmrMoveCount(int count) noexcept { lmrMoveCount = count; }
+
+    [[nodiscard]] int getLmrMoveCount() const noexcept { return lmrMoveCount; }
+
+    // Quiescence search of the leaves
+
+    void setQuiescence(bool enabled) noexcept { quiescence = enabled; }
+
+    [[nodiscard]] bool getQuiescence() const noexcept { return quiescence; }
+
     // DrawOnHumanExperience
 
     void setDrawOnHumanExperience(bool enabled) noexcept
@@ -226,6 +264,12 @@ public:
         return considerMobility;
     }
 
+    // Search statistics, dumped after each search
+
+    void setSearchStats(bool enabled) noexcept { searchStats = enabled; }
+
+    [[nodiscard]] bool getSearchStats() const noexcept { return searchStats; }
+
     // Developer Mode
 
     void setDeveloperMode(bool enabled) noexcept { developerMode = enabled; }
@@ -249,6 +293,11 @@ private:
     bool learnEndgame {false};
 #endif
     int algorithm {2};
+    bool aspirationWindow {false};
+    bool lateMoveReduction {true};
+    int lmrMinDepth {3};
+    int lmrMoveCount {4};
+    bool quiescence {true};
     bool perfectAiEnabled {false};
     bool IDSEnabled {false};
     bool depthExtension {true};
@@ -256,6 +305,7 @@ private:
     bool drawOnHumanExperience {true};
     bool considerMobility {true};
     bool developerMode {false};
+    bool searchStats {false};
 };
 
 extern GameOptions gameOptions;
@@ -15,12 +15,14 @@
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <algorithm>
+#include <cstring>
 #include <iomanip>
 #include <sstream>
 #include <string> // std::string, std::stoi
 
 #include "bitboard.h"
 #include "mills.h"
+#include "movegen.h"
 #include "option.h"
 #include "position.h"
 #include "thread.h"
@@ -488,6 +490,73 @@ bool Position::legal(Move m) const
     return true;
 }
 
+/// Position::pseudo_legal() tests whether a move, e.g. one taken from the
+/// transposition table, is among those generate<LEGAL>() would produce in the
+/// current position, without generating them.
+
+bool Position::pseudo_legal(Move m)
+{
+    const Color us = sideToMove;
+    const Square from = from_sq(m);
+    const Square to = to_sq(m);
+
+    if (to < SQ_BEGIN || to >= SQ_END) {
+        return false;
+    }
+
+    switch (action) {
+    case Action::select:
+    case Action::place:
+        if (phase == Phase::placing || phase == Phase::ready) {
+            return type_of(m) == MOVETYPE_PLACE && !board[to];
+        }
+
+        if (phase != Phase::moving || type_of(m) != MOVETYPE_MOVE ||
+            from < SQ_BEGIN || from >= SQ_END ||
+            !(board[from] & make_piece(us)) || board[to]) {
+            return false;
+        }
+
+        if (rule.mayFly &&
+            piece_on_board_count(us) <= rule.flyPieceCount) {
+            return true;
+        }
+
+        for (auto direction = MD_BEGIN; direction < MD_NB; ++direction) {
+            if (MoveList<LEGAL>::adjacentSquares[from][direction] == to) {
+                return true;
+            }
+        }
+
+        return false;
+
+    case Action::remove:
+        if (type_of(m) != MOVETYPE_REMOVE || !(board[to] & make_piece(~us))) {
+            return false;
+        }
+
+        if (is_stalemate_removal()) {
+            return is_adjacent_to(to, us);
+        }
+
+        if (is_all_in_mills(~us)) {
+#ifdef MADWEASEL_MUEHLE_RULE
+            return false;
+#else
+            return true;
+#endif
+        }
+
+        return rule.mayRemoveFromMillsAlways ||
+               !potential_mills_count(to, NOBODY);
+
+    case Action::none:
+        break;
+    }
+
+    return false;
+}
+
 /// Position::do_move() makes a move, and saves all information necessary
 /// to a StateInfo object. The move is assumed to be legal. Pseudo-legal
 /// moves should be filtered out before this function is called.
@@ -532,12 +601,120 @@ void Position::do_move(Move m)
     move = m;
 }
 
+/// Position::do_move() with an undo stack first saves the state that the move
+/// is going to change, so that Position::undo_move() can take it back.
+
+void Position::do_move(Move m, Sanmill::Stack<UndoInfo> &ss)
+{
+    UndoInfo u;
+
+    u.st = st;
+    u.move = move;
+
+    memcpy(u.byTypeBB, byTypeBB, sizeof(byTypeBB));
+    memcpy(u.byColorBB, byColorBB, sizeof(byColorBB));
+
+    for (int c = 0; c < COLOR_NB; c++) {
+        u.pieceInHandCount[c] = static_cast<int8_t>(pieceInHandCount[c]);
+        u.pieceOnBoardCount[c] = static_cast<int8_t>(pieceOnBoardCount[c]);
+        u.pieceToRemoveCount[c] = static_cast<int8_t>(pieceToRemoveCount[c]);
+    }
+
+    u.from = type_of(m) == MOVETYPE_MOVE ? from_sq(m) : SQ_0;
+    u.to = to_sq(m);
+    u.fromPiece = board[u.from];
+    u.toPiece = board[u.to];
+    u.currentSquare = currentSquare;
+
+    u.sideToMove = sideToMove;
+    u.them = them;
+    u.winner = winner;
+    u.gameOverReason = gameOverReason;
+    u.phase = phase;
+    u.action = action;
+
+    u.isNeedStalemateRemoval = isNeedStalemateRemoval;
+    u.isStalemateRemoving = isStalemateRemoving;
+    u.mobilityDiff = mobilityDiff;
+    u.gamePly = gamePly;
+
+    // The thread searching this position keeps the keys of its search path
+    if (thisThread != nullptr) {
+        KeyPath &path = thisThread->keyPath;
+        const int ply = ss.size();
+
+        path.keys[ply] = st.key;
+        path.start[ply + 1] = type_of(m) == MOVETYPE_MOVE ?
+                                  path.start[ply] :
+                                  static_cast<uint8_t>(ply + 1);
+        path.filter.add(st.key);
+    }
+
+    ss.push(u);
+
+    do_move(m);
+}
+
 /// Position::undo_move() unmakes a move. When it returns, the position should
 /// be restored to exactly the same state as before the move was made.
 
-void Position::undo_move(Sanmill::Stack<Position> &ss)
+void Position::undo_move(Sanmill::Stack<UndoInfo> &ss)
 {
-    memcpy(this, ss.top(), sizeof(Position));
+    const UndoInfo &u = *ss.top();
+
+    if (thisThread != nullptr) {
+        thisThread->keyPath.filter.remove(u.st.key);
+    }
+
+    // A game ended by the move has been counted by update_score()
+    if (phase == Phase::gameOver && u.phase != Phase::gameOver) {
+        if (winner == DRAW) {
+            score_draw--;
+        } else {
+            score[winner]--;
+        }
+    }
+
+    // Banned squares are cleared when the placing phase ends
+    const Bitboard bans = u.byTypeBB[BAN] & ~byTypeBB[BAN];
+
+    if (bans) {
+        for (Square s = SQ_BEGIN; s < SQ_END; ++s) {
+            if (bans & s) {
+                board[s] = BAN_PIECE;
+            }
+        }
+    }
+
+    board[u.from] = u.fromPiece;
+    board[u.to] = u.toPiece;
+
+    memcpy(byTypeBB, u.byTypeBB, sizeof(byTypeBB));
+    memcpy(byColorBB, u.byColorBB, sizeof(byColorBB));
+
+    for (int c = 0; c < COLOR_NB; c++) {
+        pieceInHandCount[c] = u.pieceInHandCount[c];
+        pieceOnBoardCount[c] = u.pieceOnBoardCount[c];
+        pieceToRemoveCount[c] = u.pieceToRemoveCount[c];
+    }
+
+    currentSquare = u.currentSquare;
+
+    sideToMove = u.sideToMove;
+    them = u.them;
+    winner = u.winner;
+    gameOverReason = u.gameOverReason;
+    phase = u.phase;
+    action = u.action;
+
+    isNeedStalemateRemoval = u.isNeedStalemateRemoval;
+    isStalemateRemoving = u.isStalemateRemoving;
+    mobilityDiff = u.mobilityDiff;
+    gamePly = u.gamePly;
+
+    st = u.st;
+    move = u.move;
+
     ss.pop();
 }
 
@@ -573,25 +750,44 @@ Key Position::key_after(Move m) const
 int repetition;
 
 // Position::has_repeated() tests whether there has been at least one repetition
-// of positions since the last remove.
+// of positions since the last remove. The filters over the game history and
+// the search path rule out most positions at once.
 
-bool Position::has_repeated(Sanmill::Stack<Position> &ss) const
+bool Position::has_repeated(Sanmill::Stack<UndoInfo> &ss) const
 {
+    const Key k = key();
+    const int size = ss.size();
+
+    if (thisThread != nullptr && !posKeyFilter.may_contain(k) &&
+        !thisThread->keyPath.filter.may_contain(k)) {
+        return false;
+    }
+
     for (int i = static_cast<int>(posKeyHistory.size()) - 2; i >= 0; i--) {
-        if (key() == posKeyHistory[i]) {
+        if (k == posKeyHistory[i]) {
             return true;
         }
     }
 
-    const int size = ss.size();
+    if (thisThread != nullptr) {
+        const KeyPath &path = thisThread->keyPath;
+
+        for (int i = size - 1; i >= path.start[size]; i--) {
+            if (k == path.keys[i]) {
+                return true;
+            }
+        }
+
+        return false;
+    }
 
     for (int i = size - 1; i >= 0; i--) {
+        if (k == ss[i].st.key) {
+            return true;
+        }
         if (type_of(ss[i].move) == MOVETYPE_REMOVE) {
             break;
         }
-        if (key() == ss[i].st.key) {
-            return true;
-        }
     }
 
     return false;
@@ -1282,7 +1478,6 @@ Key Position::update_key_misc()
 ///////////////////////////////////////////////////////////////////////////////
 
 #include "misc.h"
-#include "movegen.h"
 
 Bitboard Position::millTableBB[SQUARE_EXT_NB][LD_NB] = {{0}};
 
@@ -18,6 +18,7 @@
 #define POSITION_H_INCLUDED
 
 #include <cassert>
+#include <cstring>
 #include <deque>
 #include <memory> // For std::unique_ptr
 #include <string>
@@ -50,6 +51,81 @@ struct StateInfo
     Key key;
 };
 
+/// KeyFilter is a small counting filter over position keys. It tells that a
+/// key is certainly not among the keys added, so that most positions need no
+/// scan of the keys to know they are not repetitions.
+
+struct KeyFilter
+{
+    static constexpr int Size = 1024;
+
+    void add(Key k) noexcept { count[k & (Size - 1)]++; }
+
+    void remove(Key k) noexcept { count[k & (Size - 1)]--; }
+
+    void clear() noexcept { std::memset(count, 0, sizeof(count)); }
+
+    [[nodiscard]] bool may_contain(Key k) const noexcept
+    {
+        return count[k & (Size - 1)] != 0;
+    }
+
+    uint8_t count[Size] {};
+};
+
+/// KeyPath struct holds the keys of the positions on the search path of a
+/// thread by ply. Placing or removing a piece changes the material for good,
+/// so start[ply] is the first ply after the last such move, where the scan
+/// for a repetition stops.
+
+struct KeyPath
+{
+    static constexpr int Size = 128; // The capacity of the undo stack
+
+    Key keys[Size];
+    uint8_t start[Size + 1] {};
+    KeyFilter filter;
+};
+
+// The keys of the game history before the root, see posKeyHistory
+extern KeyFilter posKeyFilter;
+
+/// UndoInfo struct is the compact per-ply record pushed by the search when a
+/// move is made. It keeps only what Position::undo_move() cannot derive from
+/// the move itself, so that unmaking a move does not need a copy of the
+/// whole Position.
+
+struct UndoInfo
+{
+    StateInfo st;
+    Move move;
+
+    Bitboard byTypeBB[PIECE_TYPE_NB];
+    Bitboard byColorBB[COLOR_NB];
+
+    int8_t pieceInHandCount[COLOR_NB];
+    int8_t pieceOnBoardCount[COLOR_NB];
+    int8_t pieceToRemoveCount[COLOR_NB];
+
+    Square from;
+    Square to;
+    Piece fromPiece;
+    Piece toPiece;
+    Square currentSquare;
+
+    Color sideToMove;
+    Color them;
+    Color winner;
+    GameOverReason gameOverReason;
+    Phase phase;
+    Action action;
+
+    bool isNeedStalemateRemoval;
+    bool isStalemateRemoving;
+    int mobilityDiff;
+    int gamePly;
+};
+
 /// Position class stores information regarding the board representation as
 /// pieces, side to move, hash keys, castling info, etc. Important methods are
 /// do_move() and undo_move(), used by the search to update node info when
@@ -85,11 +161,13 @@ public:
 
     // Properties of moves
     [[nodiscard]] bool legal(Move m) const;
+    [[nodiscard]] bool pseudo_legal(Move m);
     [[nodiscard]] Piece moved_piece(Move m) const;
 
     // Doing and undoing moves
     void do_move(Move m);
-    void undo_move(Sanmill::Stack<Position> &ss);
+    void do_move(Move m, Sanmill::Stack<UndoInfo> &ss);
+    void undo_move(Sanmill::Stack<UndoInfo> &ss);
 
     // Accessing hash keys
     [[nodiscard]] Key key() const noexcept;
@@ -104,7 +182,7 @@ public:
     [[nodiscard]] int game_ply() const;
     [[nodiscard]] Thread *this_thread() const;
     [[nodiscard]] bool has_game_cycle() const;
-    bool has_repeated(Sanmill::Stack<Position> &ss) const;
+    bool has_repeated(Sanmill::Stack<UndoInfo> &ss) const;
     [[nodiscard]] unsigned int rule50_count() const;
 
     /// Mill Game
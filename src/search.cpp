@@ -14,21 +14,225 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
 #include "endgame.h"
 #include "evaluate.h"
 #include "option.h"
 #include "thread.h"
+#include "uci.h"
 
 using Eval::evaluate;
 using std::string;
 
-Value MTDF(Position *pos, Sanmill::Stack<Position> &ss, Value firstguess,
-           Depth depth, Depth originDepth, Move &bestMove);
+Value MTDF(Position *pos, Sanmill::Stack<UndoInfo> &ss, Value firstguess,
+           Depth depth, Move &bestMove);
+
+Value aspiration(Position *pos, Sanmill::Stack<UndoInfo> &ss, Value prev,
+                 Depth depth, Move &bestMove);
+
+Value qsearch(Position *pos, Sanmill::Stack<UndoInfo> &ss, Depth depth,
+              Value alpha, Value beta, Move &bestMove);
+
+Value quiescence(Position *pos, Sanmill::Stack<UndoInfo> &ss, Depth depth,
+                 Value alpha, Value beta);
+
+Search::LimitsType Search::Limits;
+TimeManagement Time;
+
+namespace {
+
+// Sizes and phases of the skip-blocks, used for distributing search depths
+// across the Lazy SMP helper threads
+constexpr int SkipSize[] = {1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                            3, 3, 4, 4, 4, 4, 4, 4, 4, 4};
+constexpr int SkipPhase[] = {0, 1, 0, 1, 2, 3, 0, 1, 2, 3,
+                             4, 5, 0, 1, 2, 3, 4, 5, 6, 7};
+
+// rule50_dependent() returns true if the N-move rule may end the game
+// within the given depth.
+
+bool rule50_dependent(const Position *pos, Depth depth)
+{
+#ifdef RULE_50
+    const unsigned int rule50 = pos->rule50_count() +
+                                std::max(0, static_cast<int>(depth));
+
+    return rule50 > rule.nMoveRule ||
+           (rule.endgameNMoveRule < rule.nMoveRule &&
+            pos->is_three_endgame() && rule50 >= rule.endgameNMoveRule);
+#else
+    (void)pos;
+    (void)depth;
+    return false;
+#endif // RULE_50
+}
+
+// update_stats() records the move that produced a beta cutoff: a quiet move
+// as a killer of the ply, a removal in the history.
+
+void update_stats(Thread *thisThread, int ply, Color us, Move move,
+                  Depth depth, bool quiet)
+{
+    if (type_of(move) == MOVETYPE_REMOVE) {
+        thisThread->history.update(us, move,
+                                   std::min(16 * depth * depth,
+                                            HistoryTable::HistoryMax / 8));
+    } else if (quiet && ply < MAX_PLY && thisThread->killers[ply][0] != move) {
+        thisThread->killers[ply][1] = thisThread->killers[ply][0];
+        thisThread->killers[ply][0] = move;
+    }
+}
+
+// extend_pv() follows the TT moves from the end of a principal variation of
+// the root. The null windows of MTD(f) cut the triangular table short
+// after the first moves, while the table still knows how the line goes on.
+
+void extend_pv(const Thread *thisThread, Move *pv, int &n)
+{
+#if defined(TRANSPOSITION_TABLE_ENABLE) && defined(TT_MOVE_ENABLE)
+    Position pos;
+    Sanmill::Stack<UndoInfo> ss;
+    Key keys[MAX_PLY + 1];
+
+    std::memcpy(static_cast<void *>(&pos), thisThread->rootPos,
+                sizeof(Position));
+    pos.thisThread = nullptr;
+
+    for (int i = 0; i < n; i++) {
+        keys[i] = pos.key();
+        pos.do_move(pv[i], ss);
+    }
 
-Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
-              Depth originDepth, Value alpha, Value beta, Move &bestMove);
+    while (n < MAX_PLY && pos.get_phase() != Phase::gameOver) {
+        TTEntry tte;
+        const Key key = pos.key();
 
-bool is_timeout(TimePoint startTime);
+        // Stop at a repetition, the line would only go round in circles
+        if (!TranspositionTable::search(key, tte) ||
+            std::find(keys, keys + n, key) != keys + n) {
+            break;
+        }
+
+        const Move move = tte.tt_move();
+
+        if (move == MOVE_NONE || !pos.pseudo_legal(move)) {
+            break;
+        }
+
+        keys[n] = key;
+        pv[n++] = move;
+        pos.do_move(move, ss);
+    }
+#else
+    (void)thisThread;
+    (void)pv;
+    (void)n;
+#endif // TRANSPOSITION_TABLE_ENABLE && TT_MOVE_ENABLE
+}
+
+// print_info() sends the UCI info lines of a finished iteration. The score
+// of a unique root move is made up, there is nothing to report.
+
+void print_info(Thread *thisThread, Depth depth, Value value)
+{
+    if (value == VALUE_UNIQUE) {
+        return;
+    }
+
+    if (thisThread->multiPV > 1) {
+        for (int i = 0; i < thisThread->lineCount; i++) {
+            Thread::RootLine &line = thisThread->rootLines[i];
+            extend_pv(thisThread, line.pv, line.pvLength);
+        }
+
+        // Keep the principal variation of the best move in step for pondering
+        thisThread->rootPvLength = thisThread->rootLines[0].pvLength;
+        std::copy_n(thisThread->rootLines[0].pv, thisThread->rootPvLength,
+                    thisThread->rootPv);
+    } else {
+        extend_pv(thisThread, thisThread->rootPv, thisThread->rootPvLength);
+    }
+
+    sync_cout << UCI::pv(thisThread, depth, value) << sync_endl;
+}
+
+// is_main() tells whether the thread is the main thread of the pool. The Qt
+// GUI searches on threads outside of the pool.
+
+bool is_main(const Thread *thisThread)
+{
+    return !Threads.empty() && Threads.front() == thisThread;
+}
+
+// pondering() tells whether the main thread of the pool is searching on the
+// time of the opponent, waiting for the expected move to be played.
+
+bool pondering(const Thread *thisThread)
+{
+    return is_main(thisThread) && Threads.main()->ponder;
+}
+
+// check_time() stops the search of the pool once the maximum time is used
+// up, or when the opponent played the expected move after we had already
+// pondered for as long as the move may take. An iteration has to be
+// completed first, so that there is a move to play. A thread outside of the
+// pool is only stopped between iterations.
+
+void check_time(const Thread *thisThread)
+{
+    if (!Time.enabled() || thisThread->completedDepth == 0 ||
+        !is_main(thisThread) || Threads.main()->ponder) {
+        return;
+    }
+
+    if (Time.elapsed() >= Time.maximum() || Threads.main()->stopOnPonderhit) {
+        Threads.stop = true;
+    }
+}
+
+// record_iteration() adds a completed iteration to the search statistics,
+// with the nodes searched and the time used by the pool so far.
+
+void record_iteration(Thread *thisThread, Depth depth)
+{
+    Thread::SearchStats &stats = thisThread->stats;
+
+    if (!gameOptions.getSearchStats() || stats.iterations >= MAX_PLY) {
+        return;
+    }
+
+    stats.iterationDepth[stats.iterations] = depth;
+    stats.iterationNodes[stats.iterations] =
+        Threads.empty() ? thisThread->nodes.load(std::memory_order_relaxed) :
+                          Threads.nodes_searched();
+    stats.iterationTime[stats.iterations] = now() - thisThread->startTime;
+    stats.iterations++;
+}
+
+// update_pv() makes the move the first of the principal variation of the
+// ply, followed by the principal variation of the next ply.
+
+void update_pv(Thread *thisThread, int ply, Move move)
+{
+    if (ply >= MAX_PLY) {
+        return;
+    }
+
+    Move *const pv = thisThread->pv[ply];
+    const int childLength = thisThread->pvLength[ply + 1];
+
+    pv[ply] = move;
+    std::copy(thisThread->pv[ply + 1] + ply + 1,
+              thisThread->pv[ply + 1] + childLength, pv + ply + 1);
+    thisThread->pvLength[ply] = childLength;
+}
+
+} // namespace
 
 /// Search::init() is called at startup
 
@@ -41,7 +245,7 @@ void Search::clear()
     Threads.main()->wait_for_search_finished();
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
-    TT.clear();
+    TranspositionTable::clear();
 #endif
     Threads.clear();
 }
@@ -56,7 +260,7 @@ extern Value nnueTrainingDataBestValue;
 
 int Thread::search()
 {
-    Sanmill::Stack<Position> ss;
+    Sanmill::Stack<UndoInfo> ss;
 
     Value value = VALUE_ZERO;
     const Depth d = get_depth();
@@ -117,8 +321,49 @@ int Thread::search()
         rootPos->st.rule50 = static_cast<unsigned>(posKeyHistory.size());
     }
 
+    posKeyFilter.clear();
+
+    for (const Key key : posKeyHistory) {
+        posKeyFilter.add(key);
+    }
+
     MoveList<LEGAL>::shuffle();
 
+    completedDepth = 0;
+    rootPvLength = 0;
+    lineCount = 0;
+    excludedCount = 0;
+    // The GUI has no options, and the helpers only help the best line
+    multiPV = is_main(this) ? std::min(static_cast<int>(Options["MultiPV"]),
+                                       MAX_MOVES) :
+                              1;
+    reset_counters();
+    startTime = now();
+    Time.init(Search::Limits, rootPos->side_to_move());
+
+#ifdef TRANSPOSITION_TABLE_ENABLE
+#ifndef CLEAR_TRANSPOSITION_TABLE
+    // The table is kept across iterations and moves, entries of earlier
+    // searches stay usable and are just the first ones to be replaced.
+    TranspositionTable::new_search();
+#endif
+#endif
+
+    // Lazy SMP: the helper threads search the same root position and share
+    // the transposition table with us. Our own iterations are unchanged.
+    // With RootSplit, the helpers wait for the root moves of each iteration.
+    const bool parallel = Threads.size() > 1 && this == Threads.front();
+    Threads.rootSplit = parallel && Options["RootSplit"];
+    const bool lazySmp = parallel && !Threads.rootSplit;
+
+    if (lazySmp) {
+        Threads.start_searching();
+    } else if (Threads.rootSplit) {
+        for (Thread *th : Threads) {
+            th->reset_counters();
+        }
+    }
+
 #if 0
     // TODO(calcitem): Only NMM
     if (rootPos->piece_on_board_count(WHITE)
@@ -132,43 +377,52 @@ int Thread::search()
     }
 #endif
 
-    Value alpha = VALUE_NONE;
-    Value beta = VALUE_NONE;
-
-    if (gameOptions.getAlgorithm() != 2 /* !MTD(f) */) {
-        alpha = -VALUE_INFINITE;
-        beta = VALUE_INFINITE;
-    }
-
-    if (gameOptions.getMoveTime() > 0 || gameOptions.getIDSEnabled()) {
-        debugPrintf("IDS: ");
+    // Score of the last completed iteration, kept when one is stopped
+    Value lastValue = VALUE_ZERO;
 
+    if (Time.enabled() || gameOptions.getIDSEnabled()) {
         constexpr Depth depthBegin = 2;
-        Value lastValue = VALUE_ZERO;
-
-        const TimePoint startTime = now();
+        TimePoint lastIteration = 0;
+        TimePoint previousIteration = 0;
 
         for (Depth i = depthBegin; i < originDepth; i += 1) {
+            const TimePoint iterationStart = Time.elapsed();
+
 #ifdef TRANSPOSITION_TABLE_ENABLE
 #ifdef CLEAR_TRANSPOSITION_TABLE
-            TranspositionTable::clear();
+            // The table is shared with the helpers, do not wipe their work
+            if (!lazySmp) {
+                TranspositionTable::clear();
+            }
 #endif
 #endif
 
-            if (gameOptions.getAlgorithm() == 2 /* MTD(f) */) {
-                // debugPrintf("Algorithm: MTD(f).\n");
-                value = MTDF(rootPos, ss, value, i, i, bestMove);
-            } else {
-                value = qsearch(rootPos, ss, i, i, alpha, beta, bestMove);
+            value = search_lines(ss, i, i, value);
+
+            if (Threads.stop.load(std::memory_order_relaxed)) {
+                value = lastValue;
+                goto out;
             }
 
-            debugPrintf("%d(%d) ", value, value - lastValue);
+            completedDepth = i;
+            print_info(this, i, value);
+            record_iteration(this, i);
 
             lastValue = value;
 
-            if (is_timeout(startTime)) {
-                debugPrintf("originDepth = %d, depth = %d\n", originDepth, i);
-                goto out;
+            previousIteration = lastIteration;
+            lastIteration = Time.elapsed() - iterationStart;
+
+            if (Time.enabled() &&
+                !Time.next_iteration_fits(lastIteration, previousIteration)) {
+                // While pondering, go on deepening and stop on ponderhit
+                if (pondering(this)) {
+                    Threads.main()->stopOnPonderhit = true;
+                } else {
+                    debugPrintf("originDepth = %d, depth = %d\n", originDepth,
+                                i);
+                    goto out;
+                }
             }
         }
 
@@ -182,24 +436,49 @@ int Thread::search()
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
 #ifdef CLEAR_TRANSPOSITION_TABLE
-    TranspositionTable::clear();
+    if (!lazySmp) {
+        TranspositionTable::clear();
+    }
 #endif
 #endif
 
-    if (gameOptions.getAlgorithm() != 2 /* !MTD(f) */
-        && gameOptions.getIDSEnabled()) {
-        alpha = -VALUE_INFINITE;
-        beta = VALUE_INFINITE;
-    }
+    value = search_lines(ss, d, originDepth, value);
 
-    if (gameOptions.getAlgorithm() == 2 /* MTD(f) */) {
-        value = MTDF(rootPos, ss, value, originDepth, originDepth, bestMove);
-    } else {
-        value = qsearch(rootPos, ss, d, originDepth, alpha, beta, bestMove);
+    if (!Threads.stop.load(std::memory_order_relaxed)) {
+        completedDepth = originDepth;
+        print_info(this, originDepth, value);
+        record_iteration(this, originDepth);
+    } else if (completedDepth > 0) {
+        value = lastValue;
     }
 
 out:
 
+    // The best move of a ponder search is only sent once the GUI tells that
+    // the expected move has been played, or stops the search.
+    while (pondering(this) && !Threads.stop.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    if (lazySmp) {
+        // Stop the helpers and adopt the result of one of them if it got
+        // further than we did, e.g. when we ran out of time.
+        Threads.stop = true;
+        Threads.wait_for_search_finished();
+
+        const Thread *bestThread = Threads.get_best_thread();
+
+        // The helpers know nothing of the other lines of a MultiPV search
+        if (bestThread != this && multiPV == 1) {
+            bestMove = bestThread->bestMove;
+            value = bestThread->bestvalue;
+
+            std::copy_n(bestThread->rootPv, bestThread->rootPvLength, rootPv);
+            rootPvLength = bestThread->rootPvLength;
+            print_info(this, bestThread->completedDepth, value);
+        }
+    }
+
 #ifdef TIME_STAT
     timeEnd = chrono::steady_clock::now();
     debugPrintf(
@@ -207,24 +486,347 @@ out:
         chrono::duration_cast<chrono::seconds>(timeEnd - timeStart).count());
 #endif
 
+    sync_cout << UCI::stats(this) << sync_endl;
+
+    if (gameOptions.getSearchStats()) {
+        sync_cout << UCI::search_stats(this) << sync_endl;
+    }
+
     lastvalue = bestvalue;
     bestvalue = value;
 
     return 0;
 }
 
+/// Thread::search_root() searches the root position once with the configured
+/// algorithm. The guess is the score the last iteration expects, MTD(f) and
+/// the aspiration windows start from it. A root split search uses neither.
+
+Value Thread::search_root(Sanmill::Stack<UndoInfo> &ss, Depth depth,
+                          Depth rootDepth, Value guess)
+{
+    if (is_main(this) && Threads.rootSplit && depth == rootDepth) {
+        return split_root(depth);
+    }
+
+    if (gameOptions.getAlgorithm() == 2 /* MTD(f) */) {
+        return MTDF(rootPos, ss, guess, depth, bestMove);
+    }
+
+    if (gameOptions.getAspirationWindow() && completedDepth > 0) {
+        // Iterative deepening has left us the score of the previous depth
+        return aspiration(rootPos, ss, guess, depth, bestMove);
+    }
+
+    return qsearch(rootPos, ss, depth, -VALUE_INFINITE, VALUE_INFINITE,
+                   bestMove);
+}
+
+/// Thread::search_lines() runs one iteration of the search. With MultiPV, the
+/// root is searched once per line, each time without the moves of the lines
+/// found before and with a window around the last score of that line. The
+/// lines are then ranked, and the best one gives the best move.
+
+Value Thread::search_lines(Sanmill::Stack<UndoInfo> &ss, Depth depth,
+                           Depth rootDepth, Value guess)
+{
+    if (multiPV == 1) {
+        return search_root(ss, depth, rootDepth, guess);
+    }
+
+    RootLine lines[MAX_MOVES];
+    int n = 0;
+
+    for (excludedCount = 0; n < multiPV; n++) {
+        bestMove = MOVE_NONE;
+        rootPvLength = 0;
+
+        const Value value = search_root(
+            ss, depth, rootDepth, n < lineCount ? rootLines[n].value : guess);
+
+        // No root move left, or stopped in the middle of the iteration
+        if (bestMove == MOVE_NONE ||
+            Threads.stop.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        if (rootPvLength == 0 || rootPv[0] != bestMove) {
+            rootPv[0] = bestMove;
+            rootPvLength = 1;
+        }
+
+        lines[n].value = value;
+        lines[n].pvLength = rootPvLength;
+        std::copy_n(rootPv, rootPvLength, lines[n].pv);
+        excludedMoves[excludedCount++] = bestMove;
+
+        // A unique move leaves nothing else to search
+        if (value == VALUE_UNIQUE) {
+            n++;
+            break;
+        }
+    }
+
+    excludedCount = 0;
+
+    // A stopped iteration keeps the lines of the last completed one
+    if (!Threads.stop.load(std::memory_order_relaxed) || lineCount == 0) {
+        std::stable_sort(lines, lines + n,
+                         [](const RootLine &a, const RootLine &b) {
+                             return a.value > b.value;
+                         });
+        std::copy_n(lines, n, rootLines);
+        lineCount = n;
+    }
+
+    if (lineCount == 0) {
+        return guess;
+    }
+
+    bestMove = rootLines[0].pv[0];
+    rootPvLength = rootLines[0].pvLength;
+    std::copy_n(rootLines[0].pv, rootPvLength, rootPv);
+
+    return rootLines[0].value;
+}
+
+/// Thread::split_root() searches the root moves in parallel on all threads
+/// of the pool. The moves are searched in the order of the move picker, the
+/// best move of the last iteration first, and the result does not depend on
+/// which thread searched which move: the best score wins, ties go to the
+/// move first in that order.
+
+Value Thread::split_root(Depth depth)
+{
+    MovePicker mp(*rootPos, rootPvLength > 0 ? rootPv[0] : MOVE_NONE);
+    mp.generate_moves();
+
+    if (excludedCount > 0) {
+        mp.exclude(excludedMoves, excludedMoves + excludedCount);
+    } else if (mp.move_count() == 1) {
+        bestMove = mp.moves[0].move;
+        rootPv[0] = bestMove;
+        rootPvLength = 1;
+
+        return VALUE_UNIQUE;
+    }
+
+    Threads.splitDepth = depth;
+    Threads.splitCount = mp.move_count();
+    std::transform(mp.moves, mp.moves + mp.move_count(), Threads.splitMoves,
+                   [](const ExtMove &m) { return m.move; });
+    Threads.splitNext = 0;
+    Threads.splitAlpha = -VALUE_INFINITE;
+    count(nodes);
+
+    // A line is only filled in once its move is fully searched
+    for (int i = 0; i < Threads.splitCount; i++) {
+        Threads.splitLines[i].pvLength = 0;
+    }
+
+    // The first move, usually the best one of the last iteration, is searched
+    // alone, so that the others start with a useful alpha
+    split_search(1);
+    Threads.start_splitting();
+    split_search();
+    Threads.wait_for_search_finished();
+
+    const Thread::RootLine *lines = Threads.splitLines;
+    const int n = Threads.splitCount;
+
+    if (n == 0) {
+        return -VALUE_INFINITE;
+    }
+
+    // A stopped iteration keeps the best move of the last completed one. If
+    // there is none, the best of the moves searched so far is played, or the
+    // first move if not even that one is done.
+    if (Threads.stop.load(std::memory_order_relaxed)) {
+        if (completedDepth == 0) {
+            const Thread::RootLine *best = nullptr;
+
+            for (int i = 0; i < n; i++) {
+                if (lines[i].pvLength > 0 &&
+                    (best == nullptr || lines[i].value > best->value)) {
+                    best = &lines[i];
+                }
+            }
+
+            if (best != nullptr) {
+                rootPvLength = best->pvLength;
+                std::copy_n(best->pv, rootPvLength, rootPv);
+            } else {
+                rootPv[0] = Threads.splitMoves[0];
+                rootPvLength = 1;
+            }
+
+            bestMove = rootPv[0];
+        }
+
+        return -VALUE_INFINITE;
+    }
+
+    const Thread::RootLine *best = std::max_element(
+        lines, lines + n, [](const RootLine &a, const RootLine &b) {
+            return a.value < b.value;
+        });
+
+    bestMove = best->pv[0];
+    rootPvLength = best->pvLength;
+    std::copy_n(best->pv, rootPvLength, rootPv);
+
+#ifdef TRANSPOSITION_TABLE_ENABLE
+    if (excludedCount == 0 && !rule50_dependent(rootPos, depth)) {
+        TranspositionTable::save(best->value, depth, BOUND_EXACT,
+                                 rootPos->key()
+#ifdef TT_MOVE_ENABLE
+                                     ,
+                                 bestMove
+#endif // TT_MOVE_ENABLE
+        );
+    }
+#endif // TRANSPOSITION_TABLE_ENABLE
+
+    return best->value;
+}
+
+/// Thread::split_search() takes the root moves of a root split search off the
+/// shared list until none is left, or the given number is searched. A move is
+/// searched with the best score so far, one point lower, as alpha: a move as
+/// good as the best one then still gets its exact score, whatever the order
+/// in which the threads finish.
+
+void Thread::split_search(int moves)
+{
+    Sanmill::Stack<UndoInfo> ss;
+    Move move = MOVE_NONE;
+    const Depth depth = Threads.splitDepth;
+
+    for (int i = 0; i < moves; i++) {
+        const int k = Threads.splitNext++;
+
+        if (k >= Threads.splitCount) {
+            break;
+        }
+
+        const Value alpha = static_cast<Value>(std::max(
+            Threads.splitAlpha.load(std::memory_order_relaxed) - 1,
+            static_cast<int>(-VALUE_INFINITE)));
+        const Move m = Threads.splitMoves[k];
+        const Color before = rootPos->sideToMove;
+        Value value;
+
+        // The move is searched from ply 1, where no node is a root
+        rootPos->do_move(m, ss);
+
+        if (rootPos->sideToMove != before) {
+            value = -qsearch(rootPos, ss, depth - 1, -VALUE_INFINITE, -alpha,
+                             move);
+        } else {
+            value = qsearch(rootPos, ss, depth - 1, alpha, VALUE_INFINITE,
+                            move);
+        }
+
+        rootPos->undo_move(ss);
+
+        if (Threads.stop.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        RootLine &line = Threads.splitLines[k];
+        line.value = value;
+        line.pv[0] = m;
+        line.pvLength = std::max(pvLength[1], 1);
+        std::copy(pv[1] + 1, pv[1] + line.pvLength, line.pv + 1);
+
+        int best = Threads.splitAlpha.load(std::memory_order_relaxed);
+
+        while (value > best && !Threads.splitAlpha.compare_exchange_weak(
+                                   best, value, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+/// Thread::helper_search() is the iterative deepening loop of the Lazy SMP
+/// helper threads. Each helper skips some depths according to its index, so
+/// that the threads spread over different depths, and only records a result
+/// once an iteration has been fully searched.
+
+void Thread::helper_search()
+{
+    Sanmill::Stack<UndoInfo> ss;
+
+    Value value = VALUE_ZERO;
+    const int i = static_cast<int>(idx - 1) % 20;
+
+    for (Depth depth = 1; depth <= originDepth; depth++) {
+        if (Threads.stop.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        // Distribute search depths across the helper threads
+        if (depth < originDepth &&
+            ((depth + SkipPhase[i]) / SkipSize[i]) % 2) {
+            continue;
+        }
+
+        Move move = MOVE_NONE;
+
+        if (gameOptions.getAlgorithm() == 2 /* MTD(f) */) {
+            value = MTDF(rootPos, ss, value, depth, move);
+        } else {
+            value = qsearch(rootPos, ss, depth, -VALUE_INFINITE,
+                            VALUE_INFINITE, move);
+        }
+
+        if (Threads.stop.load(std::memory_order_relaxed)) {
+            break;
+        }
+
+        completedDepth = depth;
+        bestMove = move;
+        bestvalue = value;
+    }
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 
 vector<Key> posKeyHistory;
+KeyFilter posKeyFilter;
 
-Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
-              Depth originDepth, Value alpha, Value beta, Move &bestMove)
+Value qsearch(Position *pos, Sanmill::Stack<UndoInfo> &ss, Depth depth,
+              Value alpha, Value beta, Move &bestMove)
 {
     Value value;
     Value bestValue = -VALUE_INFINITE;
 
     Depth epsilon;
 
+    Thread *const thisThread = pos->this_thread();
+    const int ply = ss.size();
+    const bool rootNode = ply == 0;
+    Thread::SearchStats *const stats = thisThread != nullptr &&
+                                               gameOptions.getSearchStats() ?
+                                           &thisThread->stats :
+                                           nullptr;
+
+    if (stats != nullptr) {
+        stats->plyNodes[std::min(ply, MAX_PLY)]++;
+    }
+
+    if (thisThread != nullptr) {
+        Thread::count(thisThread->nodes);
+
+        if (thisThread->idx == 0 &&
+            (thisThread->nodes.load(std::memory_order_relaxed) & 1023) == 0) {
+            check_time(thisThread);
+        }
+
+        if (ply <= MAX_PLY) {
+            thisThread->pvLength[ply] = ply;
+        }
+    }
+
 #ifdef RULE_50
     if (pos->rule50_count() > rule.nMoveRule ||
         (rule.endgameNMoveRule < rule.nMoveRule && pos->is_three_endgame() &&
@@ -240,7 +842,7 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
     // Check if we have an upcoming move which draws by repetition, or
     // if the opponent had an alternative move earlier to this position.
     if (/* alpha < VALUE_DRAW && */
-        depth != originDepth && pos->has_repeated(ss)) {
+        !rootNode && pos->has_repeated(ss)) {
         alpha = VALUE_DRAW;
         if (alpha >= beta) {
             return alpha;
@@ -248,6 +850,17 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
     }
 #endif // THREEFOLD_REPETITION
 
+    // if this isn't the root of the search tree (where we have
+    // to pick a move and can't simply return VALUE_DRAW) then check to
+    // see if the position is a repeat. if so, we can assume that
+    // this line is a draw and return VALUE_DRAW. This is done before the
+    // transposition table lookup, since an entry stored for the same
+    // position reached through another path knows nothing about it.
+    if (rule.threefoldRepetitionRule && !rootNode &&
+        pos->get_phase() == Phase::moving && pos->has_repeated(ss)) {
+        return VALUE_DRAW;
+    }
+
 #ifdef TT_MOVE_ENABLE
     Move ttMove = MOVE_NONE;
 #endif // TT_MOVE_ENABLE
@@ -289,6 +902,13 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
 
     Bound type = BOUND_NONE;
 
+    // The score of a node which may still run into the N-move rule depends
+    // on how the position was reached, so it is not shared through the table.
+    // Neither is the score of a MultiPV root searched without some moves.
+    const bool ttUsable = !rule50_dependent(pos, depth) &&
+                          (!rootNode || thisThread == nullptr ||
+                           thisThread->excludedCount == 0);
+
     const Value probeVal = TranspositionTable::probe(posKey, depth, alpha, beta,
                                                      type
 #ifdef TT_MOVE_ENABLE
@@ -297,7 +917,17 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
 #endif // TT_MOVE_ENABLE
     );
 
-    if (probeVal != VALUE_UNKNOWN) {
+    if (stats != nullptr && ttUsable && !rootNode) {
+        stats->ttProbes++;
+    }
+
+    // No cutoff at the root, where the best move has to be picked, since the
+    // entry may have been stored by another thread or an earlier search.
+    if (ttUsable && probeVal != VALUE_UNKNOWN && !rootNode) {
+        if (thisThread != nullptr) {
+            Thread::count(thisThread->ttHits);
+        }
+
 #ifdef TRANSPOSITION_TABLE_DEBUG
         Threads.main()->ttHitCount++;
 #endif
@@ -316,6 +946,13 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
 
     // process leaves
 
+    // A leaf with a removal pending or a mill to close is not quiet yet
+    if (depth <= 0 && gameOptions.getQuiescence() &&
+        pos->phase != Phase::gameOver &&
+        !Threads.stop.load(std::memory_order_relaxed)) {
+        return quiescence(pos, ss, depth, alpha, beta);
+    }
+
     // Check for aborted search
     // TODO(calcitem): and immediate draw
     if (unlikely(pos->phase == Phase::gameOver) || // TODO(calcitem): Deal with
@@ -333,67 +970,95 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
         return bestValue;
     }
 
-    // if this isn't the root of the search tree (where we have
-    // to pick a move and can't simply return VALUE_DRAW) then check to
-    // see if the position is a repeat. if so, we can assume that
-    // this line is a draw and return VALUE_DRAW.
-    if (rule.threefoldRepetitionRule && depth != originDepth &&
-        pos->has_repeated(ss)) {
-        return VALUE_DRAW;
-    }
-
     // Initialize a MovePicker object for the current position, and prepare
-    // to search the moves.
-    MovePicker mp(*pos);
-    const Move nextMove = mp.next_move();
-    const int moveCount = mp.move_count();
+    // to search the moves. The TT move is searched before the other moves are
+    // generated, except at the root, which needs all its moves up front.
+    MovePicker mp(*pos,
+#ifdef TT_MOVE_ENABLE
+                  ttMove,
+#else
+                  MOVE_NONE,
+#endif // TT_MOVE_ENABLE
+                  thisThread != nullptr && ply < MAX_PLY ?
+                      thisThread->killers[ply] :
+                      nullptr,
+                  thisThread != nullptr ? &thisThread->history : nullptr);
+
+    if (rootNode) {
+        mp.generate_moves();
+
+        if (thisThread != nullptr && thisThread->excludedCount > 0) {
+            mp.exclude(thisThread->excludedMoves,
+                       thisThread->excludedMoves + thisThread->excludedCount);
+        }
 
 #ifndef NNUE_GENERATE_TRAINING_DATA
-    if (moveCount == 1 && depth == originDepth) {
-        bestMove = nextMove;
-        bestValue = VALUE_UNIQUE;
-        return bestValue;
-    }
+        // The last line of a MultiPV search still needs its score
+        if (mp.move_count() == 1 &&
+            (thisThread == nullptr || thisThread->excludedCount == 0)) {
+            bestMove = mp.moves[0].move;
+            bestValue = VALUE_UNIQUE;
+
+            if (thisThread != nullptr) {
+                thisThread->rootPv[0] = bestMove;
+                thisThread->rootPvLength = 1;
+            }
+
+            return bestValue;
+        }
 #endif /* !NNUE_GENERATE_TRAINING_DATA */
 
-#if 0
-    // TODO(calcitem): Weak
-    if (bestMove != MOVE_NONE) {
-        for (int i = 0; i < moveCount; i++) {
-            if (mp.moves[i].move == bestMove) {
-                // TODO(calcitem): need to write value?
-                std::swap(mp.moves[0], mp.moves[i]);
-                break;
-            }
+        // Lazy SMP: helpers walk the root moves starting from a different
+        // move, so that the threads do not all search the same subtrees first.
+        const int moveCount = mp.move_count();
+
+        if (thisThread != nullptr && thisThread->idx != 0 && moveCount > 2) {
+            const int offset = 1 + static_cast<int>(thisThread->idx - 1) %
+                                       (moveCount - 1);
+            std::rotate(mp.moves, mp.moves + offset, mp.moves + moveCount);
         }
     }
+
+#ifdef TT_MOVE_ENABLE
+    Move nodeBestMove = MOVE_NONE;
 #endif // TT_MOVE_ENABLE
 
-#ifdef TRANSPOSITION_TABLE_ENABLE
-#ifndef DISABLE_PREFETCH
-    for (int i = 0; i < moveCount; i++) {
-        TranspositionTable::prefetch(pos->key_after(mp.moves[i].move));
-    }
-
-#ifdef PREFETCH_DEBUG
-    if (posKey << 8 >> 8 == 0x0) {
-        int pause = 1;
-    }
-#endif // PREFETCH_DEBUG
-#endif // !DISABLE_PREFETCH
-#endif // TRANSPOSITION_TABLE_ENABLE
+    Move move;
+    ExtMove *prefetched = nullptr;
 
     // Loop through the moves until no moves remain or a beta cutoff occurs
-    for (int i = 0; i < moveCount; i++) {
-        ss.push(*pos);
+    for (int i = 0; (move = mp.next_move()) != MOVE_NONE; i++) {
+#if defined(TRANSPOSITION_TABLE_ENABLE) && !defined(DISABLE_PREFETCH)
+        // Prefetch the entries of the other moves as soon as they exist
+        if (prefetched != mp.end()) {
+            prefetched = mp.end();
+
+            for (ExtMove *m = mp.begin(); m < mp.end(); m++) {
+                TranspositionTable::prefetch(pos->key_after(m->move));
+            }
+        }
+#endif // TRANSPOSITION_TABLE_ENABLE && !DISABLE_PREFETCH
+
         const Color before = pos->sideToMove;
-        const Move move = mp.moves[i].move;
+
+        // Late move reductions: a quiet move of the moving phase sorted after
+        // the first moves is searched to a lower depth first, with a null
+        // window. Only a move that beats alpha there gets the full search.
+        const bool reduce = gameOptions.getLateMoveReduction() &&
+                            !rootNode &&
+                            depth >= gameOptions.getLmrMinDepth() &&
+                            i >= gameOptions.getLmrMoveCount() &&
+                            mp.quiet_stage() &&
+                            pos->get_phase() == Phase::moving;
 
         // Make and search the move
-        pos->do_move(move);
+        pos->do_move(move, ss);
         const Color after = pos->sideToMove;
 
-        if (gameOptions.getDepthExtension() == true && moveCount == 1) {
+        // The number of moves is not known yet while the TT move is searched.
+        // The last root move left to a MultiPV line is not a forced reply.
+        if (gameOptions.getDepthExtension() == true && !rootNode &&
+            mp.move_count() == 1) {
             epsilon = 1;
         } else {
             epsilon = 0;
@@ -401,48 +1066,64 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
 
         // epsilon += pos->piece_to_remove_count(pos->sideToMove);
 
-        if (gameOptions.getAlgorithm() == 1 /* PVS */) {
+        bool fullDepth = true;
+
+        if (reduce && epsilon == 0) {
+            const Depth r = i >= 3 * gameOptions.getLmrMoveCount() ? 2 : 1;
+
+            if (after != before) {
+                value = -qsearch(pos, ss, depth - 1 - r,
+                                 -alpha - VALUE_PVS_WINDOW, -alpha, bestMove);
+            } else {
+                value = qsearch(pos, ss, depth - 1 - r, alpha,
+                                alpha + VALUE_PVS_WINDOW, bestMove);
+            }
+
+            fullDepth = value > alpha;
+        }
+
+        if (fullDepth && gameOptions.getAlgorithm() == 1 /* PVS */) {
             // debugPrintf("Algorithm: PVS.\n");
 
             if (i == 0) {
                 if (after != before) {
-                    value = -qsearch(pos, ss, depth - 1 + epsilon, originDepth,
-                                     -beta, -alpha, bestMove);
+                    value = -qsearch(pos, ss, depth - 1 + epsilon, -beta,
+                                     -alpha, bestMove);
                 } else {
-                    value = qsearch(pos, ss, depth - 1 + epsilon, originDepth,
-                                    alpha, beta, bestMove);
+                    value = qsearch(pos, ss, depth - 1 + epsilon, alpha, beta,
+                                    bestMove);
                 }
             } else {
                 if (after != before) {
-                    value = -qsearch(pos, ss, depth - 1 + epsilon, originDepth,
+                    value = -qsearch(pos, ss, depth - 1 + epsilon,
                                      -alpha - VALUE_PVS_WINDOW, -alpha,
                                      bestMove);
 
                     if (value > alpha && value < beta) {
-                        value = -qsearch(pos, ss, depth - 1 + epsilon,
-                                         originDepth, -beta, -alpha, bestMove);
+                        value = -qsearch(pos, ss, depth - 1 + epsilon, -beta,
+                                         -alpha, bestMove);
                         // assert(value >= alpha && value <= beta);
                     }
                 } else {
-                    value = qsearch(pos, ss, depth - 1 + epsilon, originDepth,
-                                    alpha, alpha + VALUE_PVS_WINDOW, bestMove);
+                    value = qsearch(pos, ss, depth - 1 + epsilon, alpha,
+                                    alpha + VALUE_PVS_WINDOW, bestMove);
 
                     if (value > alpha && value < beta) {
-                        value = qsearch(pos, ss, depth - 1 + epsilon,
-                                        originDepth, alpha, beta, bestMove);
+                        value = qsearch(pos, ss, depth - 1 + epsilon, alpha,
+                                        beta, bestMove);
                         // assert(value >= alpha && value <= beta);
                     }
                 }
             }
-        } else {
+        } else if (fullDepth) {
             // debugPrintf("Algorithm: Alpha-Beta.\n");
 
             if (after != before) {
-                value = -qsearch(pos, ss, depth - 1 + epsilon, originDepth,
-                                 -beta, -alpha, bestMove);
+                value = -qsearch(pos, ss, depth - 1 + epsilon, -beta, -alpha,
+                                 bestMove);
             } else {
-                value = qsearch(pos, ss, depth - 1 + epsilon, originDepth,
-                                alpha, beta, bestMove);
+                value = qsearch(pos, ss, depth - 1 + epsilon, alpha, beta,
+                                bestMove);
             }
         }
 
@@ -461,30 +1142,62 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
             bestValue = value;
 
             if (value > alpha) {
-                if (depth == originDepth) {
+                if (thisThread != nullptr) {
+                    update_pv(thisThread, ply, move);
+                }
+
+                if (rootNode) {
                     bestMove = move;
+
+                    if (thisThread != nullptr) {
+                        std::copy_n(thisThread->pv[0], thisThread->pvLength[0],
+                                    thisThread->rootPv);
+                        thisThread->rootPvLength = thisThread->pvLength[0];
+                    }
                 }
 
+#ifdef TT_MOVE_ENABLE
+                nodeBestMove = move;
+#endif // TT_MOVE_ENABLE
+
                 if (value < beta) {
                     // Update alpha! Always alpha < beta
                     alpha = value;
                 } else {
                     assert(value >= beta); // Fail high
-                    break;                 // Fail high
+
+                    if (stats != nullptr && i == 0) {
+                        stats->firstMoveCutoffs++;
+                    }
+
+                    if (thisThread != nullptr) {
+                        Thread::count(thisThread->cutoffs);
+                        update_stats(thisThread, ply, before, move, depth,
+                                     mp.quiet_stage());
+                    }
+
+                    break; // Fail high
                 }
             }
         }
     }
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
-    TranspositionTable::save(
-        bestValue, depth,
-        TranspositionTable::boundType(bestValue, oldAlpha, beta), posKey
+    if (ttUsable) {
+        const int saved = TranspositionTable::save(
+            bestValue, depth,
+            TranspositionTable::boundType(bestValue, oldAlpha, beta), posKey
 #ifdef TT_MOVE_ENABLE
-        ,
-        bestMove
+            ,
+            nodeBestMove
 #endif // TT_MOVE_ENABLE
-    );
+        );
+
+        if (stats != nullptr && saved >= 0) {
+            stats->ttStores++;
+            stats->ttReplacements += saved;
+        }
+    }
 #endif /* TRANSPOSITION_TABLE_ENABLE */
 
     // assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
@@ -492,8 +1205,87 @@ Value qsearch(Position *pos, Sanmill::Stack<Position> &ss, Depth depth,
     return bestValue;
 }
 
-Value MTDF(Position *pos, Sanmill::Stack<Position> &ss, Value firstguess,
-           Depth depth, Depth originDepth, Move &bestMove)
+/// quiescence() searches the leaves of the main search until the position
+/// is quiet: the pending removal is made and the mills that close on the
+/// next move are played out, so that the evaluation does not stop right in
+/// the middle of an exchange. The side to move may stand pat on the static
+/// evaluation instead, unless it has a piece to remove.
+
+Value quiescence(Position *pos, Sanmill::Stack<UndoInfo> &ss, Depth depth,
+                 Value alpha, Value beta)
+{
+    Thread *const thisThread = pos->this_thread();
+    Value bestValue = Eval::evaluate(*pos);
+
+    // For win quickly
+    if (bestValue > 0) {
+        bestValue += depth;
+    } else {
+        bestValue -= depth;
+    }
+
+    if (pos->phase == Phase::gameOver || depth <= -Search::QuiescencePlies ||
+        ss.size() >= MAX_PLY) {
+        return bestValue;
+    }
+
+    const Value standPat = bestValue;
+
+    if (pos->get_action() == Action::remove) {
+        bestValue = -VALUE_INFINITE;
+    } else if (bestValue >= beta) {
+        return bestValue;
+    } else if (bestValue > alpha) {
+        alpha = bestValue;
+    }
+
+    MovePicker mp(*pos);
+    Move move;
+
+    while ((move = mp.next_move()) != MOVE_NONE) {
+        const Color before = pos->sideToMove;
+        Value value;
+
+        pos->do_move(move, ss);
+
+        if (thisThread != nullptr) {
+            Thread::count(thisThread->nodes);
+
+            if (gameOptions.getSearchStats()) {
+                thisThread->stats.plyNodes[std::min(ss.size(), MAX_PLY)]++;
+            }
+        }
+
+        if (pos->sideToMove != before) {
+            value = -quiescence(pos, ss, depth - 1, -beta, -alpha);
+        } else {
+            value = quiescence(pos, ss, depth - 1, alpha, beta);
+        }
+
+        pos->undo_move(ss);
+
+        if (Threads.stop.load(std::memory_order_relaxed)) {
+            return VALUE_ZERO;
+        }
+
+        if (value > bestValue) {
+            bestValue = value;
+
+            if (value >= beta) {
+                break;
+            }
+
+            if (value > alpha) {
+                alpha = value;
+            }
+        }
+    }
+
+    return bestValue == -VALUE_INFINITE ? standPat : bestValue;
+}
+
+Value MTDF(Position *pos, Sanmill::Stack<UndoInfo> &ss, Value firstguess,
+           Depth depth, Move &bestMove)
 {
     Value g = firstguess;
     Value lowerbound = -VALUE_INFINITE;
@@ -507,8 +1299,7 @@ Value MTDF(Position *pos, Sanmill::Stack<Position> &ss, Value firstguess,
             beta = g;
         }
 
-        g = qsearch(pos, ss, depth, originDepth, beta - VALUE_MTDF_WINDOW, beta,
-                    bestMove);
+        g = qsearch(pos, ss, depth, beta - VALUE_MTDF_WINDOW, beta, bestMove);
 
         if (g < beta) {
             upperbound = g; // fail low
@@ -520,17 +1311,111 @@ Value MTDF(Position *pos, Sanmill::Stack<Position> &ss, Value firstguess,
     return g;
 }
 
-bool is_timeout(TimePoint startTime)
+/// aspiration() searches the root with a narrow window around the score of
+/// the previous iteration. If the score falls outside, the window is widened
+/// on the side where the search failed, and the root is searched again.
+
+Value aspiration(Position *pos, Sanmill::Stack<UndoInfo> &ss, Value prev,
+                 Depth depth, Move &bestMove)
+{
+    // Mate scores are too far apart from one depth to the next
+    if (prev <= -VALUE_MATE || prev >= VALUE_MATE) {
+        return qsearch(pos, ss, depth, -VALUE_INFINITE, VALUE_INFINITE,
+                       bestMove);
+    }
+
+    // The bounds are kept in int, where widening cannot overflow a Value
+    constexpr int lo = -VALUE_INFINITE;
+    constexpr int hi = VALUE_INFINITE;
+
+    int delta = VALUE_ASPIRATION_WINDOW;
+    int alpha = std::max(static_cast<int>(prev) - delta, lo);
+    int beta = std::min(static_cast<int>(prev) + delta, hi);
+
+    while (true) {
+        const Value value = qsearch(pos, ss, depth, static_cast<Value>(alpha),
+                                    static_cast<Value>(beta), bestMove);
+
+        if (Threads.stop.load(std::memory_order_relaxed)) {
+            return value;
+        }
+
+        delta += delta;
+
+        if (value <= alpha && alpha > lo) {
+            alpha = std::max(static_cast<int>(value) - delta, lo);
+        } else if (value >= beta && beta < hi) {
+            beta = std::min(static_cast<int>(value) + delta, hi);
+        } else {
+            return value;
+        }
+    }
+}
+
+/// TimeManagement::init() is called at the beginning of the search and
+/// computes the time the move may take. A fixed move time is used as a hard
+/// limit. With clocks, the remaining time is spread over the moves still to
+/// play, and the search may go on beyond the share of the move up to a few
+/// times that share. Without limits from the GUI, the MoveTime option is
+/// used, or the search is limited by depth only.
+
+void TimeManagement::init(const Search::LimitsType &limits, Color us)
 {
-    const auto limit = gameOptions.getMoveTime() * 1000;
-    const TimePoint elapsed = now() - startTime;
+    // Number of moves of a side the remaining time is spread over, when the
+    // GUI does not tell. Few games of mill last longer.
+    constexpr int MoveHorizon = 40;
+
+    // How many times its share of the time a move may take at most
+    constexpr int MaxRatio = 5;
+
+    startTime = limits.startTime ? limits.startTime : now();
+    optimumTime = maximumTime = 0;
+
+    if (limits.movetime) {
+        const auto overhead = static_cast<TimePoint>(Options["Move Overhead"]);
+
+        optimumTime = maximumTime = std::max(limits.movetime - overhead,
+                                             TimePoint(1));
+    } else if (limits.use_time_management()) {
+        const auto overhead = static_cast<TimePoint>(Options["Move Overhead"]);
+        const auto slowMover = static_cast<TimePoint>(Options["Slow Mover"]);
+        const int mtg = limits.movestogo ?
+                            std::min(limits.movestogo, MoveHorizon) :
+                            MoveHorizon;
+
+        // Keep the overhead of every move to come in reserve
+        const TimePoint timeLeft = std::max(
+            TimePoint(1), limits.time[us] + limits.inc[us] * (mtg - 1) -
+                              overhead * (2 + mtg));
+
+        maximumTime = std::max(limits.time[us] * 4 / 5 - overhead,
+                               TimePoint(1));
+        optimumTime = std::min(timeLeft / mtg * slowMover / 100, maximumTime);
+        maximumTime = std::min(optimumTime * MaxRatio, maximumTime);
+    } else if (gameOptions.getMoveTime() > 0) {
+        optimumTime = maximumTime = gameOptions.getMoveTime() * 1000;
+    }
+}
 
-    if (elapsed > limit) {
-#ifdef _WIN32
-        debugPrintf("\nTimeout. elapsed = %lld\n", elapsed);
-#endif
-        return true;
+/// TimeManagement::next_iteration_fits() tells whether a new iteration may be
+/// started, given how long the last two took. It may not once the optimum
+/// time is used up, nor if it is expected to end after the maximum time: each
+/// iteration takes about as many times longer than the last one as the last
+/// one took over the one before.
+
+bool TimeManagement::next_iteration_fits(TimePoint last,
+                                         TimePoint previous) const noexcept
+{
+    const TimePoint e = elapsed();
+
+    if (e >= optimumTime) {
+        return false;
     }
 
-    return false;
+    const double growth = std::clamp(static_cast<double>(last + 1) /
+                                         static_cast<double>(previous + 1),
+                                     1.5, 4.0);
+
+    return e + static_cast<TimePoint>(static_cast<double>(last) * growth) <
+           maximumTime;
 }
@@ -20,6 +20,8 @@
 #include <vector>
 
 #include "endgame.h"
+#include "misc.h"
+#include "types.h"
 
 #ifdef CYCLE_STAT
 #include "stopwatch.h"
@@ -29,11 +31,67 @@ using std::vector;
 
 namespace Search {
 
+// Plies the quiescence search goes on below the leaves at most
+constexpr int QuiescencePlies = 8;
+
+/// LimitsType struct stores the time limits sent by the GUI with the "go"
+/// command: the clocks and increments of both sides, or the fixed time of
+/// the move.
+
+struct LimitsType
+{
+    LimitsType() noexcept
+    {
+        time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = movetime =
+            TimePoint(0);
+        movestogo = 0;
+        startTime = TimePoint(0);
+    }
+
+    [[nodiscard]] bool use_time_management() const noexcept
+    {
+        return time[WHITE] || time[BLACK];
+    }
+
+    TimePoint time[COLOR_NB], inc[COLOR_NB], movetime, startTime;
+    int movestogo;
+};
+
+extern LimitsType Limits;
+
 void init() noexcept;
 void clear();
 
 } // namespace Search
 
+/// TimeManagement class computes how long the current move may be thought
+/// over: the optimum time, after which no new iteration is started, and the
+/// maximum time, at which the search is stopped.
+
+class TimeManagement
+{
+public:
+    void init(const Search::LimitsType &limits, Color us);
+
+    [[nodiscard]] bool enabled() const noexcept { return maximumTime > 0; }
+    [[nodiscard]] TimePoint optimum() const noexcept { return optimumTime; }
+    [[nodiscard]] TimePoint maximum() const noexcept { return maximumTime; }
+    [[nodiscard]] TimePoint elapsed() const noexcept
+    {
+        return now() - startTime;
+    }
+
+    [[nodiscard]] bool next_iteration_fits(TimePoint last,
+                                           TimePoint previous) const noexcept;
+
+private:
+    TimePoint startTime {0};
+    TimePoint optimumTime {0};
+    TimePoint maximumTime {0};
+};
+
+extern TimeManagement Time;
+
 #include "tt.h"
 
 extern vector<Key> posKeyHistory;
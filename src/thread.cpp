@@ -14,7 +14,9 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstring>
 #include <iomanip>
+#include <iostream>
 #include <utility>
 
 #include "mills.h"
@@ -56,6 +58,12 @@ Thread::Thread(size_t n
     , stdThread(&Thread::idle_loop, this)
     , timeLimit(3600)
 {
+    // Lazy SMP helpers need a root position of their own to make moves on
+    if (idx != 0)
+        helperPos = std::make_unique<Position>();
+
+    clear();
+
     wait_for_search_finished();
 }
 
@@ -75,8 +83,11 @@ Thread::~Thread()
 
 void Thread::clear() noexcept
 {
-    // TODO(calcitem): Reset histories
-    return;
+    for (auto &k : killers) {
+        k[0] = k[1] = MOVE_NONE;
+    }
+
+    history.clear();
 }
 
 /// Thread::start_searching() wakes up the thread that will start the search
@@ -130,6 +141,19 @@ void Thread::idle_loop()
 
         lk.unlock();
 
+        // Helper threads only deepen the shared transposition table, or take
+        // their share of the root moves. The main thread picks the move and
+        // talks to the GUI.
+        if (idx != 0) {
+            if (Threads.rootSplit) {
+                split_search();
+            } else {
+                helper_search();
+            }
+
+            continue;
+        }
+
         // Note: Stockfish doesn't have this
         if (rootPos == nullptr || rootPos->side_to_move() != us) {
             continue;
@@ -189,10 +213,8 @@ void Thread::setAi(Position *p)
     this->rootPos = p;
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
-#ifdef CLEAR_TRANSPOSITION_TABLE
     TranspositionTable::clear();
 #endif
-#endif
 }
 
 void Thread::setAi(Position *p, int time)
@@ -208,6 +230,13 @@ void Thread::emitCommand()
     emit command(strCommand);
 #else
     sync_cout << "bestmove " << strCommand.c_str();
+
+    // Only a searched move has a principal variation
+    if (const Move ponderMove = ponder_move();
+        ponderMove != MOVE_NONE && strCommand == UCI::move(bestMove)) {
+        std::cout << " ponder " << UCI::move(ponderMove);
+    }
+
     std::cout << sync_endl;
 
 #ifdef FLUTTER_UI
@@ -474,15 +503,44 @@ string Thread::next_move() const
     return UCI::move(bestMove);
 }
 
+/// Thread::ponder_move() returns the reply of the opponent the principal
+/// variation expects to the best move, to be pondered on, or MOVE_NONE. After
+/// a move closing a mill, the next move is our own removal.
+
+Move Thread::ponder_move() const
+{
+    if (rootPvLength < 2 || rootPv[0] != bestMove) {
+        return MOVE_NONE;
+    }
+
+    Position pos;
+    Sanmill::Stack<UndoInfo> ss;
+
+    std::memcpy(static_cast<void *>(&pos), rootPos, sizeof(Position));
+    pos.thisThread = nullptr;
+    pos.do_move(bestMove, ss);
+
+    return pos.side_to_move() != rootPos->side_to_move() ? rootPv[1] :
+                                                           MOVE_NONE;
+}
+
 #ifdef ENDGAME_LEARNING
 bool Thread::probeEndgameHash(Key posKey, Endgame &endgame)
 {
-    return endgameHashMap.find(posKey, endgame);
+    // Most positions were never learned, the filter tells so cheaply
+    if (!endgameFilter.load(std::memory_order_acquire)->may_contain(posKey)) {
+        return false;
+    }
+
+    // The table of merged results first, it needs no lock
+    return endgameTable.probe(posKey, endgame) ||
+           endgameHashMap.find(posKey, endgame);
 }
 
 int Thread::saveEndgameHash(Key posKey, const Endgame &endgame)
 {
     Key hashValue = endgameHashMap.insert(posKey, endgame);
+    endgameFilter.load(std::memory_order_acquire)->add(posKey);
     unsigned addr = hashValue * (sizeof(posKey) + sizeof(endgame));
 
     debugPrintf("[endgame] Record 0x%08I32x (%d) to Endgame hash map, TTEntry: "
@@ -495,12 +553,14 @@ int Thread::saveEndgameHash(Key posKey, const Endgame &endgame)
 void Thread::clearEndgameHashMap()
 {
     endgameHashMap.clear();
+    rebuildEndgameFilter();
 }
 
 void Thread::saveEndgameHashMapToFile()
 {
     const string filename = "endgame.txt";
     endgameHashMap.dump(filename);
+    rebuildEndgameFilter();
 
     debugPrintf("[endgame] Dump hash map to file\n");
 }
@@ -509,6 +569,8 @@ void Thread::loadEndgameFileToHashMap()
 {
     const string filename = "endgame.txt";
     endgameHashMap.load(filename);
+    endgameTable.load("endgame.tb");
+    rebuildEndgameFilter();
 }
 
 #endif // ENDGAME_LEARNING
@@ -539,7 +601,7 @@ void ThreadPool::set(size_t requested)
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
         // Reallocate the hash with the new thread pool size
-        TT.resize(static_cast<size_t>(Options["Hash"]));
+        TranspositionTable::resize(static_cast<size_t>(Options["Hash"]));
 #endif
 
         // Init thread number dependent search params.
@@ -551,18 +613,100 @@ void ThreadPool::set(size_t requested)
 
 void ThreadPool::clear() const
 {
-    for (const Thread *th : *this)
+    for (Thread *th : *this)
         th->clear();
 }
 
+/// ThreadPool::start_searching() is called by the main thread once the root
+/// position has been prepared. Every helper gets its own copy of the root
+/// position and the depth to reach, then starts its Lazy SMP search.
+
+void ThreadPool::start_searching()
+{
+    const Thread *mainThread = front();
+
+    for (Thread *th : *this) {
+        if (th == mainThread)
+            continue;
+
+        {
+            std::lock_guard lk(th->mutex);
+            std::memcpy(static_cast<void *>(th->helperPos.get()),
+                        mainThread->rootPos, sizeof(Position));
+            th->helperPos->thisThread = th;
+            th->rootPos = th->helperPos.get();
+            th->originDepth = mainThread->originDepth;
+            th->completedDepth = 0;
+            th->bestMove = MOVE_NONE;
+            th->rootPvLength = 0;
+            th->reset_counters();
+        }
+
+        th->start_searching();
+    }
+}
+
+/// ThreadPool::start_splitting() wakes up the helpers to take their share of
+/// the root moves of a root split search. Every helper gets a fresh copy of
+/// the root position, the main thread searches on the root position itself.
+
+void ThreadPool::start_splitting()
+{
+    const Thread *mainThread = front();
+
+    for (Thread *th : *this) {
+        if (th == mainThread)
+            continue;
+
+        {
+            std::lock_guard lk(th->mutex);
+            std::memcpy(static_cast<void *>(th->helperPos.get()),
+                        mainThread->rootPos, sizeof(Position));
+            th->helperPos->thisThread = th;
+            th->rootPos = th->helperPos.get();
+        }
+
+        th->start_searching();
+    }
+}
+
+/// ThreadPool::wait_for_search_finished() waits for all helper threads to
+/// finish their search.
+
+void ThreadPool::wait_for_search_finished() const
+{
+    for (Thread *th : *this)
+        if (th != front())
+            th->wait_for_search_finished();
+}
+
+/// ThreadPool::get_best_thread() returns the thread that completed the
+/// deepest iteration. The main thread wins ties.
+
+Thread *ThreadPool::get_best_thread() const
+{
+    Thread *bestThread = front();
+
+    for (Thread *th : *this)
+        if (th->completedDepth > bestThread->completedDepth &&
+            th->bestMove != MOVE_NONE)
+            bestThread = th;
+
+    return bestThread;
+}
+
 /// ThreadPool::start_thinking() wakes up main thread waiting in idle_loop() and
 /// returns immediately. Main thread will wake up other threads and start the
 /// search.
 
-void ThreadPool::start_thinking(Position *pos, bool ponderMode)
+void ThreadPool::start_thinking(Position *pos,
+                                const Search::LimitsType &limits,
+                                bool ponderMode)
 {
     main()->wait_for_search_finished();
 
+    Search::Limits = limits;
+
     main()->stopOnPonderhit = stop = false;
     increaseDepth = true;
     main()->ponder = ponderMode;
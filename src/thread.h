@@ -21,6 +21,7 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -63,13 +64,23 @@ public:
     virtual ~Thread();
 #endif
     int search();
-    static void clear() noexcept;
+    void helper_search();
+    void split_search(int moves = MAX_MOVES);
+    Value search_root(Sanmill::Stack<UndoInfo> &ss, Depth depth,
+                      Depth rootDepth, Value guess);
+    Value search_lines(Sanmill::Stack<UndoInfo> &ss, Depth depth,
+                       Depth rootDepth, Value guess);
+    Value split_root(Depth depth);
+    void clear() noexcept;
     void idle_loop();
     void start_searching();
     void wait_for_search_finished();
 
     Position *rootPos {nullptr};
 
+    // Private copy of the root position searched by a Lazy SMP helper thread
+    std::unique_ptr<Position> helperPos;
+
     // Mill Game
 
     string strCommand;
@@ -80,6 +91,7 @@ public:
     void setAi(Position *p, int time);
 
     [[nodiscard]] string next_move() const;
+    [[nodiscard]] Move ponder_move() const;
     [[nodiscard]] Depth get_depth() const;
 
     [[nodiscard]] int getTimeLimit() const { return timeLimit; }
@@ -116,6 +128,79 @@ public:
 #endif // TRANSPOSITION_TABLE_ENABLE
 
     Depth originDepth {0};
+    Depth completedDepth {0};
+
+    // Move ordering statistics, fed by the beta cutoffs of this thread. The
+    // killers are quiet moves per ply, the history scores removals.
+    Move killers[MAX_PLY][2];
+    HistoryTable history;
+
+    // Triangular principal variation table: pv[ply] holds the best line
+    // found from that ply on, of pvLength[ply] - ply moves.
+    Move pv[MAX_PLY + 1][MAX_PLY + 1];
+    int pvLength[MAX_PLY + 1];
+
+    // Principal variation of bestMove, kept apart from the table since a
+    // root search failing low does not replace the best move
+    Move rootPv[MAX_PLY + 1];
+    int rootPvLength {0};
+
+    // MultiPV: the best lines of the last completed iteration, best first.
+    // The root skips the excluded moves, those of the lines already found.
+    struct RootLine
+    {
+        Value value;
+        int pvLength;
+        Move pv[MAX_PLY + 1];
+    };
+
+    int multiPV {1};
+    int lineCount {0};
+    RootLine rootLines[MAX_MOVES];
+    Move excludedMoves[MAX_MOVES];
+    int excludedCount {0};
+
+    // Keys of the search path, kept by Position::do_move() and undo_move()
+    KeyPath keyPath;
+
+    // Search statistics, reset at the start of each search. Only this thread
+    // writes them, so count() needs no atomic read-modify-write.
+    std::atomic<uint64_t> nodes {0};
+    std::atomic<uint64_t> ttHits {0};
+    std::atomic<uint64_t> cutoffs {0};
+    TimePoint startTime {0};
+
+    static void count(std::atomic<uint64_t> &counter) noexcept
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1,
+                      std::memory_order_relaxed);
+    }
+
+    void reset_counters() noexcept
+    {
+        nodes = 0;
+        ttHits = 0;
+        cutoffs = 0;
+        stats = {};
+    }
+
+    // Instrumentation of the search, only gathered while the SearchStats
+    // option is on. Nodes are counted by ply from the root, iterations are
+    // only recorded by the thread talking to the GUI.
+    struct SearchStats
+    {
+        uint64_t plyNodes[MAX_PLY + 1];
+        uint64_t firstMoveCutoffs;
+        uint64_t ttProbes;
+        uint64_t ttStores;
+        uint64_t ttReplacements;
+        int iterations;
+        int iterationDepth[MAX_PLY];
+        uint64_t iterationNodes[MAX_PLY];
+        TimePoint iterationTime[MAX_PLY];
+    };
+
+    SearchStats stats {};
 
     Move bestMove {MOVE_NONE};
     Value bestvalue {VALUE_ZERO};
@@ -157,14 +242,42 @@ struct MainThread final : Thread
 
 struct ThreadPool : std::vector<Thread *>
 {
-    void start_thinking(Position *, bool = false);
+    void start_thinking(Position *, const Search::LimitsType &, bool = false);
     void clear() const;
     void set(size_t);
 
+    void start_searching();
+    void start_splitting();
+    void wait_for_search_finished() const;
+    [[nodiscard]] Thread *get_best_thread() const;
+    [[nodiscard]] uint64_t nodes_searched() const
+    {
+        return accumulate(&Thread::nodes);
+    }
+    [[nodiscard]] uint64_t tt_hits() const
+    {
+        return accumulate(&Thread::ttHits);
+    }
+    [[nodiscard]] uint64_t cutoffs() const
+    {
+        return accumulate(&Thread::cutoffs);
+    }
+
     MainThread *main() const { return dynamic_cast<MainThread *>(front()); }
 
     std::atomic_bool stop, increaseDepth;
 
+    // Root split: instead of Lazy SMP, the threads take the root moves off a
+    // shared list one by one. The best score so far is the alpha of the next
+    // moves, and every move leaves its score and line in splitLines.
+    bool rootSplit {false};
+    Depth splitDepth {0};
+    int splitCount {0};
+    Move splitMoves[MAX_MOVES];
+    Thread::RootLine splitLines[MAX_MOVES];
+    std::atomic<int> splitNext {0};
+    std::atomic<int> splitAlpha {0};
+
 private:
     uint64_t accumulate(std::atomic<uint64_t> Thread::*member) const noexcept
     {
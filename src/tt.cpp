@@ -14,17 +14,121 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
-#include "tt.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <iostream>
 #include <limits>
+#include <thread>
+#include <vector>
+
+#include "option.h"
+#include "thread.h"
+#include "tt.h"
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
 
-static constexpr int TRANSPOSITION_TABLE_SIZE = 0x1000000;
-HashMap<Key, TTEntry> TT(TRANSPOSITION_TABLE_SIZE);
+// Size used until the Hash option is applied, e.g. by the Qt GUI, which does
+// not go through the UCI options.
+static constexpr size_t TRANSPOSITION_TABLE_DEFAULT_MB = 128;
+
+// The top bits of a key hold the number of pieces to remove and are dropped
+// when the key is mapped to a cluster.
+static constexpr int KEY_MISC_BIT = 2;
+
+// The low bits of the zobrist part of a key are checked in the entries, and
+// the cluster index is taken from the bits above them only, so that a hit
+// always verifies ZobristCheckBits bits the index did not use. With 32-bit
+// keys this leaves 16 bits to the index, and the table is capped to fit.
+static constexpr int KEY_BITS = CHAR_BIT * sizeof(Key);
+static constexpr int ZOBRIST_CHECK_BITS = 16 - KEY_MISC_BIT;
+static constexpr int INDEX_BITS = std::min(
+    KEY_BITS - KEY_MISC_BIT - ZOBRIST_CHECK_BITS, 32);
+static constexpr uint64_t MAX_CLUSTER_COUNT = uint64_t(1) << INDEX_BITS;
+
+// A snapshot file is a SnapshotHeader followed by the clusters of the table
+// as they are in memory, in the byte order of the machine. A change of the
+// format, or of the meaning of the entries, needs a new version.
+static constexpr char SNAPSHOT_MAGIC[8] = {'S', 'A', 'N', 'M', 'I', 'L', 'L',
+                                           'T'};
+static constexpr uint32_t SNAPSHOT_VERSION = 3;
+
+struct SnapshotHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint16_t entrySize;
+    uint8_t clusterSize;
+    uint8_t keyMiscBits;
+    uint64_t ruleKey; // The rule variant the scores were searched with
+    uint64_t clusterCount;
+    uint32_t age;
+    uint32_t searchKey; // The search options the scores depend on
+    uint64_t checksum; // Of the header, with this field zero, and the table
+};
+
+static_assert(sizeof(SnapshotHeader) == 48, "Unexpected SnapshotHeader size");
+
+size_t TranspositionTable::clusterCount = 0;
+TranspositionTable::Cluster *TranspositionTable::table = nullptr;
 
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
 uint8_t transpositionTableAge;
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
+
+/// TranspositionTable::first_entry() returns a pointer to the first entry of
+/// the cluster the given key maps to. The top bits of the zobrist part of the
+/// key are scaled to [0, clusterCount), so the count need not be a power of
+/// two.
+
+std::atomic<uint64_t> *TranspositionTable::first_entry(Key key)
+{
+    const auto k = static_cast<uint32_t>(key << KEY_MISC_BIT >>
+                                         (KEY_BITS - INDEX_BITS));
+
+    return &table[static_cast<uint64_t>(k) * clusterCount >> INDEX_BITS]
+                .entry[0];
+}
+
+/// TranspositionTable::key16() returns the check bits of a key: the low bits
+/// of its zobrist part, below those the cluster index is taken from, and the
+/// number of pieces to remove, which the index leaves out.
+
+uint16_t TranspositionTable::key16(Key key)
+{
+    return static_cast<uint16_t>(
+        (key & ((1 << ZOBRIST_CHECK_BITS) - 1)) |
+        (key >> (KEY_BITS - KEY_MISC_BIT) << ZOBRIST_CHECK_BITS));
+}
+
+/// TranspositionTable::load() and TranspositionTable::store() read and write
+/// a whole entry at once. Relaxed ordering is enough, an entry is only a hint
+/// that the search verifies by its key check bits.
+
+TTEntry TranspositionTable::load(const std::atomic<uint64_t> &word)
+{
+    const uint64_t data = word.load(std::memory_order_relaxed);
+    TTEntry tte;
+
+    std::memcpy(static_cast<void *>(&tte), &data, sizeof(tte));
+
+    return tte;
+}
+
+void TranspositionTable::store(std::atomic<uint64_t> &word, const TTEntry &tte)
+{
+    uint64_t data;
+
+    std::memcpy(&data, static_cast<const void *>(&tte), sizeof(data));
+    word.store(data, std::memory_order_relaxed);
+}
+
+/// TranspositionTable::relative_age() returns how many searches ago the entry
+/// was written, 0 for an entry of the current search.
+
+int TranspositionTable::relative_age(const TTEntry &tte)
+{
+    return static_cast<uint8_t>(transpositionTableAge - tte.age8);
+}
 
 Value TranspositionTable::probe(Key key, Depth depth, Value alpha, Value beta,
                                 Bound &type
@@ -36,11 +140,18 @@ Value TranspositionTable::probe(Key key, Depth depth, Value alpha, Value beta,
 {
     TTEntry tte {};
 
-    if (!TT.find(key, tte)) {
+    if (!search(key, tte)) {
         return VALUE_UNKNOWN;
     }
 
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
+#ifdef TT_MOVE_ENABLE
+    ttMove = tte.tt_move();
+#endif // TT_MOVE_ENABLE
+
+    // Without CLEAR_TRANSPOSITION_TABLE the age is a search generation, it
+    // decides which entries are replaced first but does not invalidate them.
+#if defined(TRANSPOSITION_TABLE_FAKE_CLEAN) && \
+    defined(CLEAR_TRANSPOSITION_TABLE)
 #ifdef TRANSPOSITION_TABLE_FAKE_CLEAN_NOT_EXACT_ONLY
     if (tte.type != BOUND_EXACT) {
 #endif
@@ -50,7 +161,7 @@ Value TranspositionTable::probe(Key key, Depth depth, Value alpha, Value beta,
 #ifdef TRANSPOSITION_TABLE_FAKE_CLEAN_NOT_EXACT_ONLY
     }
 #endif
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
+#endif // TRANSPOSITION_TABLE_FAKE_CLEAN && CLEAR_TRANSPOSITION_TABLE
 
     if (depth > tte.depth()) {
         goto out;
@@ -76,24 +187,53 @@ Value TranspositionTable::probe(Key key, Depth depth, Value alpha, Value beta,
     }
 
 out:
-
-#ifdef TT_MOVE_ENABLE
-    ttMove = tte.ttMove;
-#endif // TT_MOVE_ENABLE
-
     return VALUE_UNKNOWN;
 }
 
+/// TranspositionTable::search() looks up the entry of the given key in its
+/// cluster. An entry found in persistent mode is refreshed to the current
+/// generation, so that it survives replacement for another search.
+
 bool TranspositionTable::search(Key key, TTEntry &tte)
 {
-    return TT.find(key, tte);
+    std::atomic<uint64_t> *const e = first_entry(key);
+    const uint16_t k = key16(key);
+
+    for (int i = 0; i < ClusterSize; ++i) {
+        tte = load(e[i]);
+
+        if (tte.key16 == k && tte.genBound8 != BOUND_NONE) {
+#ifndef CLEAR_TRANSPOSITION_TABLE
+            if (tte.age8 != transpositionTableAge) {
+                // Lose the refresh rather than a concurrent save
+                TTEntry refreshed = tte;
+                refreshed.age8 = transpositionTableAge;
+
+                uint64_t expected, desired;
+                std::memcpy(&expected, static_cast<void *>(&tte),
+                            sizeof(expected));
+                std::memcpy(&desired, static_cast<void *>(&refreshed),
+                            sizeof(desired));
+                e[i].compare_exchange_strong(expected, desired,
+                                             std::memory_order_relaxed);
+            }
+#endif // !CLEAR_TRANSPOSITION_TABLE
+            return true;
+        }
+    }
+
+    return false;
 }
 
 void TranspositionTable::prefetch(Key key)
 {
-    TT.prefetchValue(key);
+    ::prefetch(static_cast<void *>(first_entry(key)));
 }
 
+/// TranspositionTable::save() stores a search result. It returns -1 if the
+/// entry of the position was kept, 1 if the entry of another position was
+/// replaced, and 0 otherwise.
+
 int TranspositionTable::save(Value value, Depth depth, Bound type, Key key
 #ifdef TT_MOVE_ENABLE
                              ,
@@ -101,35 +241,55 @@ int TranspositionTable::save(Value value, Depth depth, Bound type, Key key
 #endif // TT_MOVE_ENABLE
 )
 {
-    TTEntry tte {};
+    std::atomic<uint64_t> *const e = first_entry(key);
+    const uint16_t k = key16(key);
+    std::atomic<uint64_t> *replace = e;
+    TTEntry tte = load(e[0]);
 
-    if (search(key, tte)) {
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
-        if (tte.age8 == transpositionTableAge) {
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
-            if (tte.genBound8 != BOUND_NONE && tte.depth() > depth) {
-                return -1;
-            }
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
+    // Use the entry of the same position or an empty one if there is any,
+    // otherwise replace the entry with the lowest depth, where each search
+    // an entry has been left unused for counts as 8 plies less.
+    for (int i = 0; i < ClusterSize; ++i) {
+        const TTEntry candidate = load(e[i]);
+
+        if (candidate.key16 == k || candidate.genBound8 == BOUND_NONE) {
+            replace = &e[i];
+            tte = candidate;
+            break;
+        }
+
+        if (tte.depth8 - 8 * relative_age(tte) >
+            candidate.depth8 - 8 * relative_age(candidate)) {
+            replace = &e[i];
+            tte = candidate;
         }
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
     }
 
-    tte.value8 = value;
-    tte.depth8 = depth;
-    tte.genBound8 = type;
+    // An entry of the current generation is only replaced by a result that
+    // is at least as deep, entries of older generations are always replaced.
+    if (tte.key16 == k && tte.genBound8 != BOUND_NONE &&
+        relative_age(tte) == 0 && tte.depth() > depth) {
+        return -1;
+    }
 
 #ifdef TT_MOVE_ENABLE
-    tte.ttMove = ttMove;
+    // Keep the move of the same position if the search found none
+    if (ttMove != MOVE_NONE || tte.key16 != k) {
+        tte.move16 = static_cast<int16_t>(ttMove);
+    }
 #endif // TT_MOVE_ENABLE
 
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
+    const int replaced = tte.key16 != k && tte.genBound8 != BOUND_NONE;
+
+    tte.key16 = k;
+    tte.value8 = value;
+    tte.depth8 = depth;
+    tte.genBound8 = type;
     tte.age8 = transpositionTableAge;
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
 
-    TT.insert(key, tte);
+    store(*replace, tte);
 
-    return 0;
+    return replaced;
 }
 
 Bound TranspositionTable::boundType(Value value, Value alpha, Value beta)
@@ -142,19 +302,345 @@ Bound TranspositionTable::boundType(Value value, Value alpha, Value beta)
     return BOUND_EXACT;
 }
 
+/// TranspositionTable::occupancy() looks at the entries of the first clusters
+/// of the table only. The keys are spread evenly over the clusters, so these
+/// are a fair sample of the whole table, which is never scanned in full.
+
+TranspositionTable::Occupancy TranspositionTable::occupancy()
+{
+    constexpr size_t SampleClusters = 1000 / ClusterSize;
+    const size_t n = table ? std::min(clusterCount, SampleClusters) : 0;
+    Occupancy o {};
+
+    o.sampled = n * ClusterSize;
+
+    for (size_t i = 0; i < n; ++i) {
+        for (const std::atomic<uint64_t> &word : table[i].entry) {
+            const TTEntry tte = load(word);
+
+            if (tte.genBound8 != BOUND_NONE) {
+                o.used[std::min(relative_age(tte), AgeCount - 1)]++;
+                o.depthSum += tte.depth();
+            }
+        }
+    }
+
+    return o;
+}
+
+/// TranspositionTable::hashfull() returns an estimate of the table usage in
+/// per mille, as the UCI "hashfull" field. Only the entries written by the
+/// current search count, the older ones are the first to be replaced.
+
+int TranspositionTable::hashfull()
+{
+    const Occupancy o = occupancy();
+
+    return o.sampled ? static_cast<int>(o.used[0] * 1000 / o.sampled) : 0;
+}
+
+/// checksum() hashes a block of memory into h, FNV-1a on 64-bit words, which
+/// runs at about memory speed over the table.
+
+static uint64_t checksum(const void *data, size_t size, uint64_t h)
+{
+    constexpr uint64_t Prime = 0x100000001B3ULL;
+    const auto *p = static_cast<const unsigned char *>(data);
+    size_t i = 0;
+
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, p + i, sizeof(w));
+        h = (h ^ w) * Prime;
+    }
+
+    for (; i < size; ++i) {
+        h = (h ^ p[i]) * Prime;
+    }
+
+    return h;
+}
+
+static constexpr uint64_t CHECKSUM_SEED = 0xCBF29CE484222325ULL;
+
+/// rule_key() identifies the rule variant by a hash of the game rules, leaving
+/// out their name and description. The fields are hashed one by one, so that
+/// the padding of Rule does not take part.
+
+static uint64_t rule_key()
+{
+    const uint32_t fields[] = {
+        static_cast<uint32_t>(rule.pieceCount),
+        static_cast<uint32_t>(rule.flyPieceCount),
+        static_cast<uint32_t>(rule.piecesAtLeastCount),
+        rule.hasDiagonalLines,
+        rule.hasBannedLocations,
+        rule.mayMoveInPlacingPhase,
+        rule.isDefenderMoveFirst,
+        rule.mayRemoveMultiple,
+        rule.mayRemoveFromMillsAlways,
+        rule.mayOnlyRemoveUnplacedPieceInPlacingPhase,
+        static_cast<uint32_t>(rule.boardFullAction),
+        static_cast<uint32_t>(rule.stalemateAction),
+        rule.mayFly,
+        rule.nMoveRule,
+        rule.endgameNMoveRule,
+        rule.threefoldRepetitionRule};
+
+    return checksum(fields, sizeof(fields), CHECKSUM_SEED);
+}
+
+/// search_key() identifies the evaluation and search options which change the
+/// score stored for a position and a depth.
+
+static uint32_t search_key()
+{
+    const uint32_t fields[] = {
+        gameOptions.getConsiderMobility(),
+        gameOptions.getDrawOnHumanExperience(),
+        gameOptions.getQuiescence(),
+        static_cast<uint32_t>(Search::QuiescencePlies),
+        gameOptions.getDepthExtension(),
+        gameOptions.getLateMoveReduction(),
+        static_cast<uint32_t>(gameOptions.getLmrMinDepth()),
+        static_cast<uint32_t>(gameOptions.getLmrMoveCount())};
+
+    return static_cast<uint32_t>(
+        checksum(fields, sizeof(fields), CHECKSUM_SEED));
+}
+
+/// snapshot_header() fills in the header describing the current table
+
+static SnapshotHeader snapshot_header(size_t clusterCount, size_t entrySize,
+                                      size_t clusterSize)
+{
+    SnapshotHeader header {};
+
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.entrySize = static_cast<uint16_t>(entrySize);
+    header.clusterSize = static_cast<uint8_t>(clusterSize);
+    header.keyMiscBits = KEY_MISC_BIT;
+    header.ruleKey = rule_key();
+    header.clusterCount = clusterCount;
+    header.age = transpositionTableAge;
+    header.searchKey = search_key();
+
+    return header;
+}
+
+/// TranspositionTable::save_snapshot() writes the table to a file, which
+/// load_snapshot() can read back after a restart of the engine. It returns
+/// nullptr on success and the reason of the failure otherwise. The table is
+/// copied out in chunks, so that the checksum covers exactly what is written
+/// even if a search is still running.
+
+const char *TranspositionTable::save_snapshot(const std::string &fname)
+{
+    if (!table) {
+        return "no table";
+    }
+
+    std::ofstream file(fname, std::ios::binary | std::ios::trunc);
+
+    if (!file) {
+        return "cannot create file";
+    }
+
+    SnapshotHeader header = snapshot_header(clusterCount, sizeof(TTEntry),
+                                            ClusterSize);
+    uint64_t h = checksum(&header, sizeof(header), CHECKSUM_SEED);
+    constexpr size_t ChunkClusters = 16384; // 1 MB
+    std::vector<char> chunk(ChunkClusters * sizeof(Cluster));
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for (size_t i = 0; i < clusterCount && file; i += ChunkClusters) {
+        const size_t len = std::min(ChunkClusters, clusterCount - i) *
+                           sizeof(Cluster);
+
+        std::memcpy(chunk.data(), static_cast<const void *>(&table[i]), len);
+        h = checksum(chunk.data(), len, h);
+        file.write(chunk.data(), static_cast<std::streamsize>(len));
+    }
+
+    header.checksum = h;
+    file.seekp(0);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.close();
+
+    return file ? nullptr : "write error";
+}
+
+/// TranspositionTable::load_snapshot() maps a file written by save_snapshot()
+/// and copies it into the table. A file of another format, rule variant,
+/// search options or table size is rejected and leaves the table untouched.
+/// The checksum is computed chunk by chunk while the chunk is copied, so that
+/// the file is only read once, and a file which does not match it leaves the
+/// table cleared. It returns nullptr on success and the reason of the failure
+/// otherwise.
+
+const char *TranspositionTable::load_snapshot(const std::string &fname)
+{
+    if (!Threads.empty()) {
+        Threads.main()->wait_for_search_finished();
+    }
+
+    if (!table) {
+        resize(TRANSPOSITION_TABLE_DEFAULT_MB);
+    }
+
+    size_t size = 0;
+    const void *mem = map_file(fname, size);
+
+    if (!mem) {
+        return "cannot open file";
+    }
+
+    const auto *data = static_cast<const char *>(mem);
+    const SnapshotHeader expected = snapshot_header(
+        clusterCount, sizeof(TTEntry), ClusterSize);
+    SnapshotHeader header {};
+    const char *error = nullptr;
+
+    if (size >= sizeof(header)) {
+        std::memcpy(&header, data, sizeof(header));
+    }
+
+    if (size < sizeof(header) ||
+        std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic))) {
+        error = "not a snapshot";
+    } else if (header.version != expected.version) {
+        error = "unsupported version";
+    } else if (header.entrySize != expected.entrySize ||
+               header.clusterSize != expected.clusterSize ||
+               header.keyMiscBits != expected.keyMiscBits) {
+        error = "different entry layout";
+    } else if (header.ruleKey != expected.ruleKey) {
+        error = "different rule variant";
+    } else if (header.searchKey != expected.searchKey) {
+        error = "different search options";
+    } else if (header.clusterCount != expected.clusterCount) {
+        error = "different table size";
+    } else if (size != sizeof(header) + clusterCount * sizeof(Cluster)) {
+        error = "truncated file";
+    } else {
+        const uint64_t sum = header.checksum;
+        constexpr size_t ChunkClusters = 16384; // 1 MB, stays in the cache
+        uint64_t h;
+
+        header.checksum = 0;
+        h = checksum(&header, sizeof(header), CHECKSUM_SEED);
+
+        for (size_t i = 0; i < clusterCount; i += ChunkClusters) {
+            const size_t len = std::min(ChunkClusters, clusterCount - i) *
+                               sizeof(Cluster);
+            const char *chunk = data + sizeof(header) + i * sizeof(Cluster);
+
+            h = checksum(chunk, len, h);
+            std::memcpy(static_cast<void *>(&table[i]), chunk, len);
+        }
+
+        if (h != sum) {
+            error = "checksum mismatch";
+            clear_table();
+            transpositionTableAge = 0;
+        } else {
+            transpositionTableAge = static_cast<uint8_t>(header.age);
+        }
+    }
+
+    unmap_file(mem, size);
+
+    return error;
+}
+
+/// TranspositionTable::resize() sets the size of the transposition table,
+/// measured in megabytes, and clears it. The table is allocated with large
+/// pages when the platform provides them. It has at most MAX_CLUSTER_COUNT
+/// clusters, as the index cannot tell more apart.
+
+void TranspositionTable::resize(size_t mbSize)
+{
+    if (!Threads.empty()) {
+        Threads.main()->wait_for_search_finished();
+    }
+
+    aligned_large_pages_free(table);
+
+    clusterCount = static_cast<size_t>(
+        std::min<uint64_t>(mbSize * 1024 * 1024 / sizeof(Cluster),
+                           MAX_CLUSTER_COUNT));
+    table = static_cast<Cluster *>(
+        aligned_large_pages_alloc(clusterCount * sizeof(Cluster)));
+
+    if (!table) {
+        std::cerr << "Failed to allocate " << mbSize
+                  << "MB for transposition table." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    clear_table();
+    transpositionTableAge = 0;
+}
+
+/// TranspositionTable::clear_table() zeroes the whole table. It is done in
+/// chunks by one thread per search thread, which is much faster than a
+/// single memset on a big table.
+
+void TranspositionTable::clear_table()
+{
+    const size_t threadCount = std::max<size_t>(Threads.size(), 1);
+    std::vector<std::thread> threads;
+
+    for (size_t idx = 0; idx < threadCount; ++idx) {
+        threads.emplace_back([idx, threadCount]() {
+            // Each thread will zero its part of the hash table
+            const size_t stride = clusterCount / threadCount;
+            const size_t start = stride * idx;
+            const size_t len = idx != threadCount - 1 ? stride :
+                                                        clusterCount - start;
+
+            std::memset(static_cast<void *>(&table[start]), 0,
+                        len * sizeof(Cluster));
+        });
+    }
+
+    for (std::thread &th : threads) {
+        th.join();
+    }
+}
+
 void TranspositionTable::clear()
 {
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
+    if (!table) {
+        resize(TRANSPOSITION_TABLE_DEFAULT_MB);
+        return;
+    }
+
+#if defined(TRANSPOSITION_TABLE_FAKE_CLEAN) && \
+    defined(CLEAR_TRANSPOSITION_TABLE)
     if (transpositionTableAge == std::numeric_limits<uint8_t>::max()) {
         debugPrintf("Clean TT\n");
-        TT.clear();
+        clear_table();
         transpositionTableAge = 0;
     } else {
         transpositionTableAge++;
     }
 #else
-    TT.clear();
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
+    clear_table();
+    transpositionTableAge = 0;
+#endif // TRANSPOSITION_TABLE_FAKE_CLEAN && CLEAR_TRANSPOSITION_TABLE
+}
+
+/// TranspositionTable::new_search() is called at the beginning of every new
+/// search when the table is kept across searches. It starts a new generation,
+/// so that entries of the current search are preferred over older ones when
+/// an entry has to be replaced.
+
+void TranspositionTable::new_search()
+{
+    transpositionTableAge++;
 }
 
 #endif /* TRANSPOSITION_TABLE_ENABLE */
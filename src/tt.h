@@ -17,19 +17,26 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
-#include "hashmap.h"
-#include "types.h"
+#include <atomic>
+#include <string>
 
-using CTSL::HashMap;
+#include "misc.h"
+#include "types.h"
 
 #ifdef TRANSPOSITION_TABLE_ENABLE
 
-/// TTEntry struct is the 4 bytes transposition table entry, defined as below:
+/// TTEntry struct is the 8 bytes transposition table entry, defined as below:
 ///
+/// key check bits     16 bit
+/// move               16 bit
 /// value               8 bit
 /// depth               8 bit
 /// bound type          8 bit
 /// age                 8 bit
+///
+/// The table stores each entry as a single 64-bit atomic word, so threads
+/// probe and save concurrently without a lock and never see a torn entry.
+/// The key check bits are low key bits, which the cluster index never uses.
 
 struct TTEntry
 {
@@ -51,26 +58,51 @@ struct TTEntry
     }
 
 #ifdef TT_MOVE_ENABLE
-    Move tt_move() const noexcept { return (Move)(ttMove); }
+    Move tt_move() const noexcept { return static_cast<Move>(move16); }
 #endif // TT_MOVE_ENABLE
 
 private:
     friend class TranspositionTable;
 
+    uint16_t key16 {0};
+    int16_t move16 {0};
     int8_t value8 {0};
     int8_t depth8 {0};
     uint8_t genBound8 {0};
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
     uint8_t age8 {0};
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
-#ifdef TT_MOVE_ENABLE
-    Move ttMove {MOVE_NONE};
-#endif // TT_MOVE_ENABLE
 };
 
+static_assert(sizeof(TTEntry) == sizeof(uint64_t), "Unexpected TTEntry size");
+
+/// TranspositionTable is an array of Cluster, of size clusterCount. Each
+/// cluster consists of ClusterSize number of entries and fills one cache line,
+/// which is prefetched when possible. An entry is empty while its bound type
+/// is BOUND_NONE.
+
 class TranspositionTable
 {
+    static constexpr int CacheLineSize = 64;
+    static constexpr int ClusterSize = CacheLineSize / sizeof(TTEntry);
+
+    struct alignas(CacheLineSize) Cluster
+    {
+        std::atomic<uint64_t> entry[ClusterSize];
+    };
+
+    static_assert(sizeof(Cluster) == CacheLineSize, "Unexpected Cluster size");
+
 public:
+    // Usage of a sample of the entries, by how many searches ago they were
+    // written. The last count holds the entries of all the older searches.
+    static constexpr int AgeCount = 4;
+
+    struct Occupancy
+    {
+        size_t sampled;
+        size_t used[AgeCount];
+        int depthSum;
+    };
+
     static bool search(Key key, TTEntry &tte);
 
     static Value probe(Key key, Depth depth, Value alpha, Value beta,
@@ -90,19 +122,34 @@ public:
 
     static Bound boundType(Value value, Value alpha, Value beta);
 
+    static void resize(size_t mbSize);
     static void clear();
+    static void new_search();
 
     static void prefetch(Key key);
 
+    static int hashfull();
+    static Occupancy occupancy();
+    static size_t cluster_count() noexcept { return clusterCount; }
+
+    static const char *save_snapshot(const std::string &fname);
+    static const char *load_snapshot(const std::string &fname);
+
 private:
     friend struct TTEntry;
-};
 
-extern HashMap<Key, TTEntry> TT;
+    static std::atomic<uint64_t> *first_entry(Key key);
+    static uint16_t key16(Key key);
+    static TTEntry load(const std::atomic<uint64_t> &word);
+    static void store(std::atomic<uint64_t> &word, const TTEntry &tte);
+    static void clear_table();
+    static int relative_age(const TTEntry &tte);
+
+    static size_t clusterCount;
+    static Cluster *table;
+};
 
-#ifdef TRANSPOSITION_TABLE_FAKE_CLEAN
 extern uint8_t transpositionTableAge;
-#endif // TRANSPOSITION_TABLE_FAKE_CLEAN
 
 #endif // TRANSPOSITION_TABLE_ENABLE
 
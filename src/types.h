@@ -197,6 +197,7 @@ enum Value : int8_t {
 
     VALUE_MTDF_WINDOW = VALUE_EACH_PIECE,
     VALUE_PVS_WINDOW = VALUE_EACH_PIECE,
+    VALUE_ASPIRATION_WINDOW = VALUE_EACH_PIECE,
 
     VALUE_PLACING_WINDOW = VALUE_EACH_PIECE_PLACING_NEEDREMOVE +
                            (VALUE_EACH_PIECE_ONBOARD -
@@ -14,6 +14,9 @@
 // You should have received a copy of the GNU General Public License
 // along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
+#include <iomanip>
+#include <iostream>
+#include <set>
 #include <sstream>
 #include <vector>
 
@@ -47,6 +50,36 @@ const char *StartFEN12 = "********/********/******** w p p 0 12 0 12 0 0 1";
 
 char StartFEN[BUFSIZ];
 
+// Set when a rule or evaluation option has changed since the last search.
+// These settings are not part of the position key, so the results kept from
+// the earlier searches can no longer be trusted.
+bool optionsChanged = false;
+
+// The options that change the values of the positions. The others only change
+// how, or how long, the engine searches, and keep the results valid.
+const std::set<string, UCI::CaseInsensitiveLess> ResultOptions = {
+    "DrawOnHumanExperience",
+    "ConsiderMobility",
+    "PiecesCount",
+    "flyPieceCount",
+    "PiecesAtLeastCount",
+    "HasDiagonalLines",
+    "HasBannedLocations",
+    "MayMoveInPlacingPhase",
+    "IsDefenderMoveFirst",
+    "MayRemoveMultiple",
+    "MayRemoveFromMillsAlways",
+    "MayOnlyRemoveUnplacedPieceInPlacingPhase",
+    "BoardFullAction",
+    "StalemateAction",
+    "MayFly",
+    "NMoveRule",
+    "EndgameNMoveRule",
+    "ThreefoldRepetitionRule"};
+
+// The HashFile option the transposition table was last restored from
+string loadedHashFile = "<empty>";
+
 // position() is called when engine receives the "position" UCI command.
 // The function sets up the position described in the given FEN string ("fen")
 // or the starting position ("startpos") and then makes the moves given in the
@@ -106,25 +139,72 @@ void setoption(istringstream &is)
     while (is >> token)
         value += (value.empty() ? "" : " ") + token;
 
-    if (Options.count(name))
+    if (Options.count(name)) {
         Options[name] = value;
-    else
+
+        if (ResultOptions.count(name))
+            optionsChanged = true;
+    } else {
         sync_cout << "No such option: " << name << sync_endl;
+    }
 }
 
 // go() is called when engine receives the "go" UCI command. The function sets
 // the thinking time and other parameters from the input string, then starts
 // the search.
 
-void go(Position *pos)
+void go(Position *pos, istringstream &is)
 {
+    Search::LimitsType limits;
+    string token;
+    bool ponderMode = false;
+
+    while (is >> token)
+        if (token == "wtime")
+            is >> limits.time[WHITE];
+        else if (token == "btime")
+            is >> limits.time[BLACK];
+        else if (token == "winc")
+            is >> limits.inc[WHITE];
+        else if (token == "binc")
+            is >> limits.inc[BLACK];
+        else if (token == "movestogo")
+            is >> limits.movestogo;
+        else if (token == "movetime")
+            is >> limits.movetime;
+        else if (token == "ponder")
+            ponderMode = true;
+
 #ifdef UCI_AUTO_RE_GO
 begin:
 #endif
 
+    limits.startTime = now(); // The clock runs from the command on
     repetition = 0;
 
-    Threads.start_thinking(pos);
+    if (optionsChanged) {
+        Search::clear();
+        optionsChanged = false;
+    }
+
+#ifdef TRANSPOSITION_TABLE_ENABLE
+    // Warm start from the snapshot of an earlier run, once the options have
+    // settled. A snapshot of other rules or of another table size is ignored.
+    if (const string hashFile = Options["HashFile"];
+        hashFile != loadedHashFile) {
+        loadedHashFile = hashFile;
+
+        if (hashFile != "<empty>") {
+            if (const char *error = TranspositionTable::load_snapshot(
+                    hashFile)) {
+                sync_cout << "info string tt load " << hashFile << ": "
+                          << error << sync_endl;
+            }
+        }
+    }
+#endif
+
+    Threads.start_thinking(pos, limits, ponderMode);
 
     if (pos->get_phase() == Phase::gameOver) {
 #ifdef UCI_AUTO_RESTART
@@ -148,6 +228,66 @@ begin:
 #endif
 }
 
+// tt() is called when engine receives the "tt" command. "tt stats" reports
+// the usage of the transposition table from a sample of its entries, by how
+// many searches ago they were written. "tt save" and "tt load" write and
+// read a snapshot of the table, to the given file or to the HashFile option.
+
+void tt(istringstream &is)
+{
+    string token, fname;
+
+    is >> token >> fname;
+
+#ifdef TRANSPOSITION_TABLE_ENABLE
+    if (fname.empty())
+        fname = static_cast<string>(Options["HashFile"]);
+
+    if ((token == "save" || token == "load") && fname == "<empty>") {
+        sync_cout << "info string tt " << token << ": no file" << sync_endl;
+        return;
+    }
+
+    if (token == "save" || token == "load") {
+        const char *error = token == "save" ?
+                                TranspositionTable::save_snapshot(fname) :
+                                TranspositionTable::load_snapshot(fname);
+
+        // A table just restored replaces what earlier options left in it
+        if (token == "load" && !error)
+            optionsChanged = false;
+
+        sync_cout << "info string tt " << token << " " << fname << ": "
+                  << (error ? error : "ok") << sync_endl;
+        return;
+    }
+
+    if (token != "stats") {
+        sync_cout << "Unknown command: tt " << token << sync_endl;
+        return;
+    }
+
+    const TranspositionTable::Occupancy o = TranspositionTable::occupancy();
+    size_t used = 0;
+
+    for (const size_t n : o.used)
+        used += n;
+
+    sync_cout << "info string tt clusters "
+              << TranspositionTable::cluster_count() << " sampled " << o.sampled
+              << " hashfull " << TranspositionTable::hashfull() << " used "
+              << (o.sampled ? used * 1000 / o.sampled : 0) << " age "
+              << static_cast<int>(transpositionTableAge) << " current "
+              << o.used[0] << " previous " << o.used[1] << " before "
+              << o.used[2] << " older " << o.used[3] << " depth "
+              << std::fixed << std::setprecision(1)
+              << (used ? static_cast<double>(o.depthSum) / used : 0.0)
+              << sync_endl;
+#else
+    sync_cout << "info string tt disabled" << sync_endl;
+#endif
+}
+
 } // namespace
 
 /// UCI::loop() waits for a command from stdin, parses it and calls the
@@ -244,7 +384,7 @@ void UCI::loop(int argc, char *argv[])
         else if (token == "setoption")
             setoption(is);
         else if (token == "go")
-            go(pos);
+            go(pos, is);
         else if (token == "position")
             position(pos, is);
         else if (token == "ucinewgame")
@@ -256,21 +396,36 @@ void UCI::loop(int argc, char *argv[])
         // Do not use these commands during a search!
         else if (token == "d")
             sync_cout << *pos << sync_endl;
+        else if (token == "tt")
+            tt(is);
         else if (token == "compiler")
             sync_cout << compiler_info() << sync_endl;
         else
             sync_cout << "Unknown command: " << cmd << sync_endl;
     } while (token != "quit" && argc == 1); // Command line args are one-shot
 
+#ifdef TRANSPOSITION_TABLE_ENABLE
+    // Keep the table for the next run
+    if (const string hashFile = Options["HashFile"]; hashFile != "<empty>") {
+        Threads.main()->wait_for_search_finished();
+
+        if (const char *error = TranspositionTable::save_snapshot(hashFile)) {
+            sync_cout << "info string tt save " << hashFile << ": " << error
+                      << sync_endl;
+        }
+    }
+#endif
+
     delete pos;
 }
 
 /// UCI::value() converts a Value to a string suitable for use with the UCI
 /// protocol specification:
 ///
-/// cp <x>    The score from the engine's point of view in pieces.
-/// mate <y>  Mate in y moves, not plies. If the engine is getting mated
-///           use negative values for y.
+/// cp <x>    The score from the engine's point of view, one piece being worth
+///           100.
+/// mate <s>  A won (+) or lost (-) game. Mate values do not depend on the ply
+///           they are found at, so the distance to the mate is not known.
 
 string UCI::value(Value v)
 {
@@ -278,10 +433,162 @@ string UCI::value(Value v)
 
     stringstream ss;
 
-    if (abs(v) < VALUE_MATE_IN_MAX_PLY)
-        ss << "cp " << v / PieceValue;
+    if (abs(v) < VALUE_MATE)
+        ss << "cp " << static_cast<int>(v) * 100 / PieceValue;
     else
-        ss << "mate " << (v > 0 ? VALUE_MATE - v + 1 : -VALUE_MATE - v) / 2;
+        ss << "mate " << (v > 0 ? '+' : '-');
+
+    return ss.str();
+}
+
+/// UCI::pv() formats the principal variation of the best move of a thread,
+/// with the depth, score, node count and speed of the search and the usage of
+/// the transposition table, as a UCI info line. A MultiPV search gets one
+/// line per ranked root move.
+
+string UCI::pv(const Thread *th, Depth depth, Value v)
+{
+    const TimePoint elapsed = now() - th->startTime + 1;
+    const uint64_t nodesSearched =
+        Threads.empty() ? th->nodes.load(std::memory_order_relaxed) :
+                          Threads.nodes_searched();
+    stringstream hashfull;
+    stringstream ss;
+
+#ifdef TRANSPOSITION_TABLE_ENABLE
+    hashfull << " hashfull " << TranspositionTable::hashfull();
+#endif
+
+    if (th->multiPV == 1) {
+        ss << "info depth " << static_cast<int>(depth) << " score " << value(v)
+           << " nodes " << nodesSearched << " nps "
+           << nodesSearched * 1000 / elapsed << hashfull.str() << " time "
+           << elapsed << " pv";
+
+        for (int i = 0; i < th->rootPvLength; ++i)
+            ss << " " << move(th->rootPv[i]);
+
+        return ss.str();
+    }
+
+    for (int i = 0; i < th->lineCount; ++i) {
+        const Thread::RootLine &line = th->rootLines[i];
+
+        if (i > 0)
+            ss << "\n";
+
+        ss << "info depth " << static_cast<int>(depth) << " multipv " << i + 1
+           << " score " << value(line.value) << " nodes " << nodesSearched
+           << " nps " << nodesSearched * 1000 / elapsed << hashfull.str()
+           << " time " << elapsed << " pv";
+
+        for (int j = 0; j < line.pvLength; ++j)
+            ss << " " << move(line.pv[j]);
+    }
+
+    return ss.str();
+}
+
+/// UCI::stats() formats the statistics of the search of a thread and its
+/// helpers, summed over all threads of the pool, as a UCI info line. A thread
+/// outside of the pool, as the Qt GUI uses, only reports its own.
+
+string UCI::stats(const Thread *th)
+{
+    const TimePoint elapsed = now() - th->startTime + 1;
+    const bool pooled = !Threads.empty();
+    const uint64_t nodesSearched =
+        pooled ? Threads.nodes_searched() :
+                 th->nodes.load(std::memory_order_relaxed);
+    const uint64_t ttHits = pooled ? Threads.tt_hits() :
+                                     th->ttHits.load(std::memory_order_relaxed);
+    const uint64_t cutoffs = pooled ?
+                                 Threads.cutoffs() :
+                                 th->cutoffs.load(std::memory_order_relaxed);
+    stringstream ss;
+
+    ss << "info nodes " << nodesSearched << " nps "
+       << nodesSearched * 1000 / elapsed << " time " << elapsed
+       << " string tthits " << ttHits << " cutoffs " << cutoffs;
+
+    return ss.str();
+}
+
+/// UCI::search_stats() formats the statistics the SearchStats option gathers
+/// as a single line of JSON, after "info string": the iterations of the
+/// thread with their nodes, time and effective branching factor, and the
+/// nodes per ply, first move cutoff rate and TT hit and replacement rates,
+/// summed over all threads of the pool.
+
+string UCI::search_stats(const Thread *th)
+{
+    const bool pooled = !Threads.empty();
+    const Thread::SearchStats &own = th->stats;
+    Thread::SearchStats sum = own;
+
+    if (pooled) {
+        sum = {};
+
+        for (const Thread *t : Threads) {
+            for (int i = 0; i <= MAX_PLY; ++i)
+                sum.plyNodes[i] += t->stats.plyNodes[i];
+
+            sum.firstMoveCutoffs += t->stats.firstMoveCutoffs;
+            sum.ttProbes += t->stats.ttProbes;
+            sum.ttStores += t->stats.ttStores;
+            sum.ttReplacements += t->stats.ttReplacements;
+        }
+    }
+
+    const uint64_t ttHits = pooled ? Threads.tt_hits() :
+                                     th->ttHits.load(std::memory_order_relaxed);
+    const uint64_t cutoffs = pooled ?
+                                 Threads.cutoffs() :
+                                 th->cutoffs.load(std::memory_order_relaxed);
+    const auto rate = [](uint64_t n, uint64_t total) {
+        return total == 0 ? 0.0 : static_cast<double>(n) / total;
+    };
+    stringstream ss;
+
+    ss << std::fixed << std::setprecision(3) << "info string {\"iterations\":[";
+
+    for (int i = 0; i < own.iterations; ++i) {
+        const uint64_t nodes = own.iterationNodes[i] -
+                               (i > 0 ? own.iterationNodes[i - 1] : 0);
+        const uint64_t previous = i == 0 ? 0 :
+                                  own.iterationNodes[i - 1] -
+                                      (i > 1 ? own.iterationNodes[i - 2] : 0);
+
+        ss << (i > 0 ? "," : "") << "{\"depth\":" << own.iterationDepth[i]
+           << ",\"nodes\":" << nodes << ",\"time\":"
+           << own.iterationTime[i] -
+                  (i > 0 ? own.iterationTime[i - 1] : TimePoint(0))
+           << ",\"ebf\":" << rate(nodes, previous) << "}";
+    }
+
+    int plies = MAX_PLY + 1;
+
+    while (plies > 0 && sum.plyNodes[plies - 1] == 0)
+        --plies;
+
+    ss << "],\"plyNodes\":[";
+
+    for (int i = 0; i < plies; ++i)
+        ss << (i > 0 ? "," : "") << sum.plyNodes[i];
+
+    ss << "],\"branchingFactor\":[";
+
+    for (int i = 1; i < plies; ++i)
+        ss << (i > 1 ? "," : "")
+           << rate(sum.plyNodes[i], sum.plyNodes[i - 1]);
+
+    ss << "],\"cutoffs\":" << cutoffs
+       << ",\"firstMoveCutoffRate\":" << rate(sum.firstMoveCutoffs, cutoffs)
+       << ",\"ttProbes\":" << sum.ttProbes
+       << ",\"ttHitRate\":" << rate(ttHits, sum.ttProbes)
+       << ",\"ttStores\":" << sum.ttStores
+       << ",\"ttReplaceRate\":" << rate(sum.ttReplacements, sum.ttStores)
+       << "}";
 
     return ss.str();
 }
@@ -24,6 +24,7 @@
 #include "types.h"
 
 class Position;
+class Thread;
 
 namespace UCI {
 
@@ -68,6 +69,9 @@ private:
 void init(OptionsMap &);
 void loop(int argc, char *argv[]);
 std::string value(Value v);
+std::string pv(const Thread *th, Depth depth, Value v);
+std::string stats(const Thread *th);
+std::string search_stats(const Thread *th);
 std::string square(Square s);
 std::string move(Move m);
 Move to_move(Position *pos, const std::string &str);
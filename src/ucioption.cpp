@@ -35,7 +35,7 @@ void on_clear_hash(const Option &)
 void on_hash_size(const Option &o)
 {
 #ifdef TRANSPOSITION_TABLE_ENABLE
-    TT.resize(static_cast<size_t>(o));
+    TranspositionTable::resize(static_cast<size_t>(o));
 #endif
 }
 
@@ -74,6 +74,31 @@ void on_algorithm(const Option &o)
     gameOptions.setAlgorithm(static_cast<int>(o));
 }
 
+void on_aspirationWindow(const Option &o)
+{
+    gameOptions.setAspirationWindow(o);
+}
+
+void on_lateMoveReduction(const Option &o)
+{
+    gameOptions.setLateMoveReduction(o);
+}
+
+void on_lmrMinDepth(const Option &o)
+{
+    gameOptions.setLmrMinDepth(static_cast<int>(o));
+}
+
+void on_lmrMoveCount(const Option &o)
+{
+    gameOptions.setLmrMoveCount(static_cast<int>(o));
+}
+
+void on_quiescence(const Option &o)
+{
+    gameOptions.setQuiescence(o);
+}
+
 void on_drawOnHumanExperience(const Option &o)
 {
     gameOptions.setDrawOnHumanExperience(o);
@@ -84,6 +109,11 @@ void on_considerMobility(const Option &o)
     gameOptions.setConsiderMobility(o);
 }
 
+void on_searchStats(const Option &o)
+{
+    gameOptions.setSearchStats(o);
+}
+
 void on_developerMode(const Option &o)
 {
     gameOptions.setDeveloperMode(o);
@@ -191,10 +221,12 @@ void init(OptionsMap &o)
                                      "Both",
                                      "Both");
     o["Threads"] << Option(1, 1, 512, on_threads);
-    o["Hash"] << Option(16, 1, MaxHashMB, on_hash_size);
+    o["Hash"] << Option(128, 1, MaxHashMB, on_hash_size);
     o["Clear Hash"] << Option(on_clear_hash);
+    o["HashFile"] << Option("<empty>");
     o["Ponder"] << Option(false);
     o["MultiPV"] << Option(1, 1, 500);
+    o["RootSplit"] << Option(false);
     o["SkillLevel"] << Option(1, 0, 30, on_skill_level);
     o["MoveTime"] << Option(1, 0, 60, on_move_time);
     o["AiIsLazy"] << Option(false, on_aiIsLazy);
@@ -207,9 +239,15 @@ void init(OptionsMap &o)
 
     o["Shuffling"] << Option(true, on_random_move);
     o["Algorithm"] << Option(2, 0, 2, on_algorithm);
+    o["AspirationWindow"] << Option(false, on_aspirationWindow);
+    o["LateMoveReduction"] << Option(true, on_lateMoveReduction);
+    o["LMRMinDepth"] << Option(3, 2, 30, on_lmrMinDepth);
+    o["LMRMoveCount"] << Option(4, 1, 72, on_lmrMoveCount);
+    o["Quiescence"] << Option(true, on_quiescence);
     o["DrawOnHumanExperience"] << Option(true, on_drawOnHumanExperience);
     o["ConsiderMobility"] << Option(true, on_considerMobility);
     o["DeveloperMode"] << Option(true, on_developerMode);
+    o["SearchStats"] << Option(false, on_searchStats);
 
     // Rules
     o["PiecesCount"] << Option(9, 9, 12, on_piecesCount);
@@ -126,6 +126,8 @@ void Game::loadSettings()
     setSkillLevel(empty ? 1 : settings->value("Options/SkillLevel").toInt());
     setMoveTime(empty ? 1 : settings->value("Options/MoveTime").toInt());
     setAlgorithm(empty ? 2 : settings->value("Options/Algorithm").toInt());
+    setAspirationWindow(
+        empty ? false : settings->value("Options/AspirationWindow").toBool());
     setDrawOnHumanExperience(
         empty ? true :
                 settings->value("Options/DrawOnHumanExperience").toBool());
@@ -641,6 +643,12 @@ void Game::setAlgorithm(int val) const
     settings->setValue("Options/Algorithm", val);
 }
 
+void Game::setAspirationWindow(bool enabled) const
+{
+    gameOptions.setAspirationWindow(enabled);
+    settings->setValue("Options/AspirationWindow", enabled);
+}
+
 void Game::setDrawOnHumanExperience(bool enabled) const
 {
     gameOptions.setDrawOnHumanExperience(enabled);
@@ -26,6 +26,7 @@
 #ifndef GAME_H_INCLUDED
 #define GAME_H_INCLUDED
 
+#include <iostream>
 #include <map>
 #include <vector>
 
@@ -218,6 +219,9 @@ public slots:
     void setMtdfAlgorithm(bool enabled) const;
     void setAlgorithm(int val) const;
 
+    // Aspiration windows
+    void setAspirationWindow(bool enabled) const;
+
     // Draw on human experience
     void setDrawOnHumanExperience(bool enabled) const;
 
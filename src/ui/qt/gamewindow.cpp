@@ -212,6 +212,9 @@ void MillGameWindow::initialize()
     connect(ui.actionMtdfAlgorithm, SIGNAL(toggled(bool)), game,
             SLOT(setMtdfAlgorithm(bool)));
 
+    connect(ui.actionAspirationWindow, SIGNAL(toggled(bool)), game,
+            SLOT(setAspirationWindow(bool)));
+
     connect(ui.actionDrawOnHumanExperience, SIGNAL(toggled(bool)), game,
             SLOT(setDrawOnHumanExperience(bool)));
 
@@ -439,6 +442,7 @@ void MillGameWindow::initialize()
         break;
     }
 
+    ui.actionAspirationWindow->setChecked(gameOptions.getAspirationWindow());
     ui.actionDrawOnHumanExperience->setChecked(
         gameOptions.getDrawOnHumanExperience());
     ui.actionConsiderMobility->setChecked(gameOptions.getConsiderMobility());
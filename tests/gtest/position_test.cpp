@@ -0,0 +1,131 @@
+// This file is part of Sanmill.
+// Copyright (C) 2019-2023 The Sanmill developers (see AUTHORS file)
+//
+// Sanmill is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Sanmill is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+
+#include "gtest/gtest.h"
+
+#include "bitboard.h"
+#include "movegen.h"
+#include "position.h"
+#include "stack.h"
+
+namespace {
+
+class PositionTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        Bitboards::init();
+        Position::init();
+    }
+
+    // Make and unmake every legal move down to the given depth and check
+    // that undo_move() restores the position byte for byte.
+    void check_undo(Position &pos, Sanmill::Stack<UndoInfo> &ss, int depth)
+    {
+        if (depth == 0) {
+            return;
+        }
+
+        alignas(Position) unsigned char before[sizeof(Position)];
+        const int size = ss.size();
+
+        for (const ExtMove &m : MoveList<LEGAL>(pos)) {
+            memcpy(before, static_cast<void *>(&pos), sizeof(Position));
+
+            pos.do_move(m.move, ss);
+            check_undo(pos, ss, depth - 1);
+            pos.undo_move(ss);
+
+            ASSERT_EQ(memcmp(before, static_cast<void *>(&pos),
+                             sizeof(Position)),
+                      0);
+            ASSERT_EQ(ss.size(), size);
+        }
+    }
+
+    // Check that pseudo_legal() accepts exactly the moves generate<LEGAL>()
+    // produces, in every position down to the given depth.
+    void check_pseudo_legal(Position &pos, Sanmill::Stack<UndoInfo> &ss,
+                            int depth)
+    {
+        const MoveList<LEGAL> moveList(pos);
+        int accepted = 0;
+
+        for (Square to = SQ_BEGIN; to < SQ_END; ++to) {
+            accepted += pos.pseudo_legal(static_cast<Move>(to));
+            accepted += pos.pseudo_legal(static_cast<Move>(-to));
+
+            for (Square from = SQ_BEGIN; from < SQ_END; ++from) {
+                accepted += pos.pseudo_legal(make_move(from, to));
+            }
+        }
+
+        ASSERT_EQ(accepted, static_cast<int>(moveList.size()));
+
+        if (depth == 0) {
+            return;
+        }
+
+        for (const ExtMove &m : moveList) {
+            ASSERT_TRUE(pos.pseudo_legal(m.move));
+
+            pos.do_move(m.move, ss);
+            check_pseudo_legal(pos, ss, depth - 1);
+            pos.undo_move(ss);
+        }
+    }
+};
+
+TEST_F(PositionTest, undoMovePlacing)
+{
+    Position pos;
+    Sanmill::Stack<UndoInfo> ss;
+
+    pos.set("********/********/******** w p p 0 9 0 9 0 0 1", nullptr);
+    check_undo(pos, ss, 4);
+}
+
+TEST_F(PositionTest, undoMoveMoving)
+{
+    Position pos;
+    Sanmill::Stack<UndoInfo> ss;
+
+    pos.set("O*O*O@**/@O*@*O@*/O*@***O@ w m s 7 0 6 0 0 0 0 1", nullptr);
+    check_undo(pos, ss, 4);
+}
+
+TEST_F(PositionTest, pseudoLegalPlacing)
+{
+    Position pos;
+    Sanmill::Stack<UndoInfo> ss;
+
+    pos.set("********/********/******** w p p 0 9 0 9 0 0 1", nullptr);
+    check_pseudo_legal(pos, ss, 3);
+}
+
+TEST_F(PositionTest, pseudoLegalMoving)
+{
+    Position pos;
+    Sanmill::Stack<UndoInfo> ss;
+
+    pos.set("O*O*O@**/@O*@*O@*/O*@***O@ w m s 7 0 6 0 0 0 0 1", nullptr);
+    check_pseudo_legal(pos, ss, 3);
+}
+
+} // namespace
@@ -0,0 +1,137 @@
+// This file is part of Sanmill.
+// Copyright (C) 2019-2023 The Sanmill developers (see AUTHORS file)
+//
+// Sanmill is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Sanmill is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "bitboard.h"
+#include "movegen.h"
+#include "position.h"
+#include "search.h"
+#include "thread.h"
+#include "uci.h"
+
+namespace {
+
+// Positions with only a few legal moves, and the skill level at which the
+// MTD(f) search used to lose the last MultiPV line
+struct FewMoves
+{
+    const char *fen;
+    size_t moveCount;
+    const char *skillLevel;
+};
+
+const FewMoves FewMovesPositions[] = {
+    {"O*O@@O@@/O@O*@***/O***OO*O b m p 9 0 6 0 0 0 4 28", 3, "10"},
+    {"OOOO@*@*/O@***O@@/O****OO@ w m p 9 0 6 0 0 0 5 28", 5, "7"},
+    {"@O**@OOO/*@******/****@@** w m p 4 0 5 0 0 0 12 41", 2, "10"},
+};
+
+class SearchTest : public testing::Test
+{
+protected:
+    static void SetUpTestSuite()
+    {
+        UCI::init(Options);
+        Bitboards::init();
+        Position::init();
+        Threads.set(1);
+    }
+
+    static void TearDownTestSuite() { Threads.set(0); }
+
+    void SetUp() override
+    {
+        Options["MultiPV"] = "1";
+        Options["MoveTime"] = "0";
+        Options["SkillLevel"] = "10";
+        Search::clear();
+    }
+
+    // Search the position and wait for the result. The main thread only
+    // searches for the side it plays.
+    static void think(Position &pos)
+    {
+        Threads.main()->us = pos.side_to_move();
+        Threads.start_thinking(&pos, Search::LimitsType(), false);
+        Threads.main()->wait_for_search_finished();
+    }
+
+    // Check that each move of a line is legal where it is played
+    static void expect_legal(const Position &root, const Move *pv, int n)
+    {
+        Position pos;
+
+        std::memcpy(static_cast<void *>(&pos), &root, sizeof(Position));
+        pos.thisThread = nullptr;
+
+        for (int i = 0; i < n; ++i) {
+            const MoveList<LEGAL> moves(pos);
+
+            ASSERT_TRUE(moves.contains(pv[i])) << "move " << i;
+            pos.do_move(pv[i]);
+        }
+    }
+};
+
+// With as many lines as root moves, the last line is searched with a single
+// root move left, which must still be searched as the root
+TEST_F(SearchTest, multiPVAsManyLinesAsMoves)
+{
+    Options["Algorithm"] = "2";
+
+    for (const FewMoves &few : FewMovesPositions) {
+        SCOPED_TRACE(few.fen);
+
+        Position pos;
+        pos.set(few.fen, Threads.main());
+
+        const MoveList<LEGAL> moves(pos);
+        ASSERT_EQ(moves.size(), few.moveCount);
+
+        Options["MultiPV"] = std::to_string(moves.size());
+        Options["SkillLevel"] = few.skillLevel;
+        Search::clear();
+        think(pos);
+
+        const Thread *th = Threads.main();
+        std::vector<Move> firstMoves;
+
+        ASSERT_EQ(th->lineCount, static_cast<int>(moves.size()));
+
+        for (int i = 0; i < th->lineCount; ++i) {
+            const Thread::RootLine &line = th->rootLines[i];
+
+            ASSERT_GT(line.pvLength, 0);
+            expect_legal(pos, line.pv, line.pvLength);
+            firstMoves.push_back(line.pv[0]);
+        }
+
+        std::sort(firstMoves.begin(), firstMoves.end());
+        EXPECT_EQ(std::unique(firstMoves.begin(), firstMoves.end()),
+                  firstMoves.end());
+
+        EXPECT_EQ(th->rootPv[0], th->rootLines[0].pv[0]);
+        expect_legal(pos, th->rootPv, th->rootPvLength);
+    }
+}
+
+} // namespace
@@ -0,0 +1,133 @@
+// This file is part of Sanmill.
+// Copyright (C) 2019-2023 The Sanmill developers (see AUTHORS file)
+//
+// Sanmill is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// Sanmill is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+#include <climits>
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "option.h"
+#include "tt.h"
+
+#ifdef TRANSPOSITION_TABLE_ENABLE
+
+namespace {
+
+constexpr int KeyBits = CHAR_BIT * sizeof(Key);
+constexpr int KeyMiscBits = 2;
+
+// A key with the number of pieces to remove cleared
+constexpr Key SomeKey = static_cast<Key>(0x2B7E151628AED2A6ULL) <<
+                        KeyMiscBits >> KeyMiscBits;
+
+class TranspositionTableTest : public testing::Test
+{
+protected:
+    void SetUp() override { TranspositionTable::resize(128); }
+
+    static void save(Key key)
+    {
+        TranspositionTable::save(VALUE_DRAW, 4, BOUND_EXACT, key
+#ifdef TT_MOVE_ENABLE
+                                 ,
+                                 MOVE_NONE
+#endif // TT_MOVE_ENABLE
+        );
+    }
+
+    static bool found(Key key)
+    {
+        TTEntry tte;
+
+        return TranspositionTable::search(key, tte);
+    }
+};
+
+TEST_F(TranspositionTableTest, findsSavedKey)
+{
+    save(SomeKey);
+
+    EXPECT_TRUE(found(SomeKey));
+}
+
+// Keys which only differ in the bits the cluster index is taken from go to
+// different clusters, and are both kept
+TEST_F(TranspositionTableTest, indexBitsAreNotCheckBits)
+{
+    int indexBits = 0;
+
+    while (static_cast<size_t>(2) << indexBits <=
+           TranspositionTable::cluster_count()) {
+        indexBits++;
+    }
+
+    for (int bit = KeyBits - KeyMiscBits - indexBits;
+         bit < KeyBits - KeyMiscBits; ++bit) {
+        const Key other = SomeKey ^ static_cast<Key>(1) << bit;
+
+        ASSERT_GE(bit, 16 - KeyMiscBits);
+
+        TranspositionTable::clear();
+        save(SomeKey);
+
+        EXPECT_FALSE(found(other)) << "bit " << bit;
+
+        save(other);
+
+        EXPECT_TRUE(found(SomeKey)) << "bit " << bit;
+        EXPECT_TRUE(found(other)) << "bit " << bit;
+    }
+}
+
+TEST_F(TranspositionTableTest, checkBitsTellKeysApart)
+{
+    save(SomeKey);
+
+    for (int bit = 0; bit < 16 - KeyMiscBits; ++bit) {
+        EXPECT_FALSE(found(SomeKey ^ static_cast<Key>(1) << bit))
+            << "bit " << bit;
+    }
+
+    EXPECT_FALSE(found(SomeKey | static_cast<Key>(1)
+                                     << (KeyBits - KeyMiscBits)));
+}
+
+// The scores of a snapshot depend on the search options it was saved with
+TEST_F(TranspositionTableTest, snapshotNeedsSameSearchOptions)
+{
+    const std::string fname = testing::TempDir() + "tt_snapshot_test.bin";
+    const bool mobility = gameOptions.getConsiderMobility();
+
+    save(SomeKey);
+    ASSERT_EQ(TranspositionTable::save_snapshot(fname), nullptr);
+
+    gameOptions.setConsiderMobility(!mobility);
+    EXPECT_STREQ(TranspositionTable::load_snapshot(fname),
+                 "different search options");
+    gameOptions.setConsiderMobility(mobility);
+
+    TranspositionTable::clear();
+
+    EXPECT_EQ(TranspositionTable::load_snapshot(fname), nullptr);
+    EXPECT_TRUE(found(SomeKey));
+
+    std::remove(fname.c_str());
+}
+
+} // namespace
+
+#endif // TRANSPOSITION_TABLE_ENABLE